@@ -0,0 +1,306 @@
+#include "ADC_FILTER.h"
+
+// Running sum moving average. Each new sample replaces the oldest one in the
+// window, so the sum is updated with one subtract and one add instead of
+// re-adding the whole buffer on every conversion.
+
+void tFILTER_init(tFILTER* ptFilter, uint16_t *pu16Buf, uint16_t u16Size)
+{
+    uint8_t u8Shift = 0;
+
+    ptFilter->pu16Buf = pu16Buf;
+    ptFilter->u16Size = u16Size;
+
+    while (((uint32_t)1 << u8Shift) < u16Size)
+        u8Shift++;
+
+    if (((uint32_t)1 << u8Shift) == u16Size)
+        ptFilter->u8Shift = u8Shift;
+    else
+        ptFilter->u8Shift = FILTER_NO_SHIFT;
+
+    ptFilter->u8Robust = FILTER_RAW;
+    ptFilter->u8RobustSize = 0;
+    tFILTER_rst(ptFilter);
+}
+
+void tFILTER_rst(tFILTER* ptFilter)
+{
+    uint16_t i;
+
+    for (i = 0; i < ptFilter->u16Size; i++)
+        ptFilter->pu16Buf[i] = 0;
+
+    ptFilter->u16Index = 0;
+    ptFilter->u32Sum = 0;
+    ptFilter->u8Full = 0;
+    ptFilter->u16Out = 0;
+
+    ptFilter->u8RobustIndex = 0;
+    ptFilter->u8RobustFull = 0;
+}
+
+// Spike rejection ahead of the average, set after tFILTER_init and kept
+// by tFILTER_rst. A single spike in the boxcar biases the mean for the
+// whole window; the median of 3 removes it, the median of 5 also a pair.
+// Any other window size has no network and leaves the channel FILTER_RAW.
+void tFILTER_robust(tFILTER* ptFilter, uint8_t u8Mode, uint8_t u8Size)
+{
+    if (u8Size != 3 && u8Size != 5)
+        u8Mode = FILTER_RAW;
+
+    ptFilter->u8Robust = u8Mode;
+    ptFilter->u8RobustSize = u8Size;
+    ptFilter->u8RobustIndex = 0;
+    ptFilter->u8RobustFull = 0;
+}
+
+static void filter_ce(uint16_t *pu16A, uint16_t *pu16B)
+{
+    if (*pu16A > *pu16B)
+    {
+        uint16_t t = *pu16A;
+        *pu16A = *pu16B;
+        *pu16B = t;
+    }
+}
+
+// Median of 3 or 5 by a compare-exchange network (3 or 7 exchanges),
+// sorts p partially
+static uint16_t filter_median(uint16_t *p, uint8_t u8Size)
+{
+    if (u8Size == 3)
+    {
+        filter_ce(&p[0], &p[1]);
+        filter_ce(&p[1], &p[2]);
+        filter_ce(&p[0], &p[1]);
+        return p[1];
+    }
+
+    filter_ce(&p[0], &p[1]);
+    filter_ce(&p[3], &p[4]);
+    filter_ce(&p[0], &p[3]);
+    filter_ce(&p[1], &p[4]);
+    filter_ce(&p[1], &p[2]);
+    filter_ce(&p[2], &p[3]);
+    filter_ce(&p[1], &p[2]);
+    return p[2];
+}
+
+// Sliding median or Hampel on the last u8RobustSize samples, returns the
+// window centre (or its replacement), so it lags by half the window. Fixed
+// cost: one or two median networks, no loops over the boxcar.
+static uint16_t robust_push(tFILTER* ptFilter, uint16_t u16Sample)
+{
+    uint16_t *w = ptFilter->au16Robust;
+    uint8_t n = ptFilter->u8RobustSize;
+    uint16_t s[FILTER_ROBUST_MAX];
+    uint16_t med, mad, centre, dist;
+    uint32_t limit;
+    uint8_t i, c;
+
+    // The first sample stands in for the ones before it
+    if (!ptFilter->u8RobustFull)
+    {
+        for (i = 0; i < n; i++)
+            w[i] = u16Sample;
+        ptFilter->u8RobustIndex = 0;
+        ptFilter->u8RobustFull = 1;
+    }
+
+    w[ptFilter->u8RobustIndex] = u16Sample;
+    c = ptFilter->u8RobustIndex + 1 + n / 2;       // Centre, oldest + n/2
+    if (c >= n) c -= n;
+    if (++ptFilter->u8RobustIndex >= n)
+        ptFilter->u8RobustIndex = 0;
+
+    for (i = 0; i < n; i++)
+        s[i] = w[i];
+    med = filter_median(s, n);
+    if (ptFilter->u8Robust == FILTER_MEDIAN)
+        return med;
+
+    // Hampel: the centre is kept unless it is further from the median
+    // than 3 sigma, estimated from the median absolute deviation
+    for (i = 0; i < n; i++)
+        s[i] = w[i] > med ? w[i] - med : med - w[i];
+    mad = filter_median(s, n);
+
+    centre = w[c];
+    dist = centre > med ? centre - med : med - centre;
+    limit = ((uint32_t)mad * FILTER_HAMPEL_K_Q4) >> 4;
+    if (limit < FILTER_HAMPEL_MIN)
+        limit = FILTER_HAMPEL_MIN;
+
+    return dist > limit ? med : centre;
+}
+
+uint16_t tFILTER_push(tFILTER* ptFilter, uint16_t u16Sample)
+{
+    uint16_t *pu16Slot = &ptFilter->pu16Buf[ptFilter->u16Index];
+
+    if (ptFilter->u8Robust != FILTER_RAW)
+        u16Sample = robust_push(ptFilter, u16Sample);
+
+    // Slots start at zero, so the subtract is harmless while filling
+    ptFilter->u32Sum -= *pu16Slot;
+    ptFilter->u32Sum += u16Sample;
+    *pu16Slot = u16Sample;
+
+    ptFilter->u16Index++;
+    if (ptFilter->u16Index >= ptFilter->u16Size) {
+        ptFilter->u16Index = 0;
+        ptFilter->u8Full = 1;
+    }
+
+    if (ptFilter->u8Full) {
+        if (ptFilter->u8Shift != FILTER_NO_SHIFT)
+            ptFilter->u16Out = (uint16_t)(ptFilter->u32Sum >> ptFilter->u8Shift);
+        else
+            ptFilter->u16Out = (uint16_t)(ptFilter->u32Sum / ptFilter->u16Size);
+    }
+
+    return ptFilter->u16Out;
+}
+
+// Rounded average of a block of conversions (DMA block acquisition), pushed
+// into a tFILTER as one oversampled sample. Power of two blocks use a shift.
+uint16_t tFILTER_block_avg(const uint16_t *pu16Block, uint16_t u16Count)
+{
+    uint32_t u32Sum = 0;
+    uint16_t i;
+    uint8_t u8Shift = 0;
+
+    for (i = 0; i < u16Count; i++)
+        u32Sum += pu16Block[i];
+
+    while (((uint32_t)1 << u8Shift) < u16Count)
+        u8Shift++;
+
+    if (((uint32_t)1 << u8Shift) == u16Count)
+        return (uint16_t)((u32Sum + (u16Count >> 1)) >> u8Shift);
+
+    return (uint16_t)((u32Sum + (u16Count >> 1)) / u16Count);
+}
+
+void tKALMAN_init(tKALMAN* ptKalman, uint32_t u32Q, uint32_t u32R)
+{
+    ptKalman->i32X = 0;
+    ptKalman->u32P = 0;
+    ptKalman->u16Out = 0;
+    ptKalman->u32Q = u32Q;
+    ptKalman->u32R = u32R;
+    tKALMAN_rst(ptKalman);
+}
+
+// The input has moved by an unknown amount, the next sample starts again.
+// u16Out keeps the last estimate until then.
+void tKALMAN_rst(tKALMAN* ptKalman)
+{
+    ptKalman->u8Full = 0;
+}
+
+// x * k / 65536 for a gain k below 1 (Q16), rounded: the upper and the lower
+// half of x each times k, so no product is wider than 32 bits
+static int32_t kalman_gain(int32_t x, uint16_t k)
+{
+    return (x >> 16) * (int32_t)k + (int32_t)(((uint32_t)(x & 0xFFFF) * k + 32768) >> 16);
+}
+
+// One predict and update step. The gain P / (P + R) is one 32 by 16 bit
+// division, both reduced to 16 bits first, and the two updates are the
+// gain times a 32 bit value, four 16 by 16 bit multiplies in all.
+uint16_t tKALMAN_push(tKALMAN* ptKalman, uint16_t u16Sample)
+{
+    uint32_t p, s;
+    uint16_t k;
+    int32_t e;
+
+    // The first sample is the estimate, P = R, the gain of a 1/n mean
+    if (!ptKalman->u8Full)
+    {
+        ptKalman->i32X = (int32_t)u16Sample << 15;
+        ptKalman->u32P = ptKalman->u32R;
+        ptKalman->u8Full = 1;
+        ptKalman->u16Out = u16Sample;
+        return u16Sample;
+    }
+
+    // Predict: the input is a random walk
+    p = ptKalman->u32P + ptKalman->u32Q;
+    if (p < ptKalman->u32Q) p = UINT32_MAX;
+
+    // Update, a gain of 1 is taken as 0xFFFF
+    s = p + ptKalman->u32R;
+    if (s < p) s = UINT32_MAX;
+    if (s == 0)
+    {
+        k = 0xFFFF;
+    }
+    else
+    {
+        uint32_t pk = p;
+
+        while (s > 0xFFFF)
+        {
+            s >>= 1;
+            pk >>= 1;
+        }
+        k = pk >= s ? 0xFFFF : (uint16_t)((pk << 16) / s);
+    }
+
+    // k < 1, the estimate moves towards the sample and stays in range
+    e = ((int32_t)u16Sample << 15) - ptKalman->i32X;
+    ptKalman->i32X += kalman_gain(e, k);
+    ptKalman->u32P = p - ((p >> 16) * k + (((p & 0xFFFF) * k) >> 16));
+    ptKalman->u16Out = (uint16_t)((ptKalman->i32X + 16384) >> 15);
+
+    return ptKalman->u16Out;
+}
+
+// Clamps u8Bits to DECIM_BITS_MAX and rounds u16Samples up to a power of
+// two of at least 4^n, fewer conversions would not carry the extra bits.
+void tDECIM_init(tDECIM* ptDecim, uint8_t u8Bits, uint16_t u16Samples)
+{
+    uint8_t u8Log2;
+
+    if (u8Bits > DECIM_BITS_MAX)
+        u8Bits = DECIM_BITS_MAX;
+
+    u8Log2 = 2 * u8Bits;
+    while (((uint32_t)1 << u8Log2) < u16Samples && ((uint32_t)1 << u8Log2) < DECIM_SAMPLES_MAX)
+        u8Log2++;
+
+    ptDecim->u8Bits = u8Bits;
+    ptDecim->u16Samples = (uint16_t)1 << u8Log2;
+    ptDecim->u8Shift = u8Log2 - u8Bits;
+    ptDecim->u16Count = 0;
+    ptDecim->u32Sum = 0;
+    ptDecim->u16Out = 0;
+}
+
+// Adds a block of conversions, 1 when u16Out holds a new output: the sum of
+// u16Samples conversions shifted down by u8Shift, rounded. A block may end
+// in the middle of a sum, the rest carries over to the next one. With no
+// extra bits and u16Samples the block length it is tFILTER_block_avg.
+uint8_t tDECIM_push(tDECIM* ptDecim, const uint16_t *pu16Block, uint16_t u16Count)
+{
+    uint8_t u8Ready = 0;
+    uint16_t i;
+
+    for (i = 0; i < u16Count; i++)
+    {
+        ptDecim->u32Sum += pu16Block[i];
+        if (++ptDecim->u16Count < ptDecim->u16Samples)
+            continue;
+
+        if (ptDecim->u8Shift)
+            ptDecim->u32Sum += (uint32_t)1 << (ptDecim->u8Shift - 1);
+        ptDecim->u16Out = (uint16_t)(ptDecim->u32Sum >> ptDecim->u8Shift);
+        ptDecim->u16Count = 0;
+        ptDecim->u32Sum = 0;
+        u8Ready = 1;
+    }
+
+    return u8Ready;
+}
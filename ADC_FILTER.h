@@ -0,0 +1,85 @@
+#ifndef ADC_FILTER_H
+#define ADC_FILTER_H
+
+#include <stdint.h>
+
+#define FILTER_NO_SHIFT 0xFF    // Window is not a power of two, average with a divide
+
+#define FILTER_ROBUST_MAX 5     // Longest median / Hampel window
+
+#define FILTER_RAW      0       // Samples go straight into the average
+#define FILTER_MEDIAN   1       // Sliding median ahead of the average
+#define FILTER_HAMPEL   2       // Sliding Hampel: only outliers are replaced by the median
+
+#define FILTER_HAMPEL_K_Q4 71   // Outlier beyond 3 sigma, sigma = 1.4826 MAD, in Q4
+#ifndef FILTER_HAMPEL_MIN
+#define FILTER_HAMPEL_MIN 8     // Smallest outlier distance (LSB), a flat window has a MAD of 0
+#endif
+
+// Moving average filter, one instance per ADC channel
+typedef struct {
+    uint16_t *pu16Buf;     // Sample window (u16Size entries, owned by the caller)
+    uint16_t u16Size;      // Window length
+    uint16_t u16Index;     // Next slot to overwrite (oldest sample)
+    uint32_t u32Sum;       // Running sum of the samples in the window
+    uint8_t u8Shift;       // log2(u16Size) for power of two windows, else FILTER_NO_SHIFT
+    uint8_t u8Full;        // Set once every slot holds a real sample
+    uint16_t u16Out;       // Last window average
+
+    uint8_t u8Robust;      // FILTER_RAW, FILTER_MEDIAN or FILTER_HAMPEL ahead of the average
+    uint8_t u8RobustSize;  // Median / Hampel window, 3 or 5 (else FILTER_RAW), delays the samples by half of it
+    uint8_t u8RobustIndex; // Next slot of au16Robust to overwrite
+    uint8_t u8RobustFull;  // Set once the window is primed with the first sample
+    uint16_t au16Robust[FILTER_ROBUST_MAX];
+} tFILTER;
+
+// Scalar Kalman filter on a random walk input, one instance per ADC channel.
+// The noise reduction of a long moving average without its buffer.
+// Converged, it is an exponential average with a gain of about sqrt(Q/R).
+// When the input is known to have moved (a duty change) tKALMAN_rst starts
+// a new estimate: the gain is 1/n over the n samples since, the mean of the
+// new level without the old samples a boxcar keeps for a whole window.
+// Variances in Q24 LSB^2, up to 256 LSB^2, so a small Q/R still resolves.
+#define KALMAN_Q24(f) ((uint32_t)((f) * 16777216.0f + 0.5f))
+
+typedef struct {
+    uint32_t u32Q;         // Process noise, variance of the input change per sample (LSB^2, Q24)
+    uint32_t u32R;         // Measurement noise variance of one sample (LSB^2, Q24)
+    int32_t i32X;          // Estimate (LSB, Q15), 16 bit codes and their differences fit
+    uint32_t u32P;         // Estimate variance (LSB^2, Q24)
+    uint8_t u8Full;        // Set by the first sample, which starts the estimate
+    uint16_t u16Out;       // Last estimate (LSB)
+} tKALMAN;
+
+// Oversampling and decimation ahead of the filter. The sum of 4^n
+// conversions shifted down by n is a 12 + n bit code: the noise dithers
+// the conversions over more than one LSB, so their mean resolves a
+// fraction of it. Fed whole DMA blocks, an output every u16Samples
+// conversions, so the output rate is the conversion rate / u16Samples.
+// u16Samples is a power of two, so a longer sum is a longer shift.
+#define DECIM_BITS_MAX 4        // 16 bit codes, 256 conversions per output
+#define DECIM_SAMPLES_MAX 32768 // Longest sum, 12-bit codes still fit 32 bits
+
+typedef struct {
+    uint8_t u8Bits;        // Extra bits n of the output, up to DECIM_BITS_MAX
+    uint16_t u16Samples;   // Conversions per output, a power of two of at least 4^n
+    uint8_t u8Shift;       // log2(u16Samples) - n
+    uint16_t u16Count;     // Conversions summed so far
+    uint32_t u32Sum;
+    uint16_t u16Out;       // Last output, a (12 + n)-bit code
+} tDECIM;
+
+void tFILTER_init(tFILTER* ptFilter, uint16_t *pu16Buf, uint16_t u16Size);
+void tFILTER_rst(tFILTER* ptFilter);
+void tFILTER_robust(tFILTER* ptFilter, uint8_t u8Mode, uint8_t u8Size);
+uint16_t tFILTER_push(tFILTER* ptFilter, uint16_t u16Sample);
+uint16_t tFILTER_block_avg(const uint16_t *pu16Block, uint16_t u16Count);
+
+void tKALMAN_init(tKALMAN* ptKalman, uint32_t u32Q, uint32_t u32R);
+void tKALMAN_rst(tKALMAN* ptKalman);
+uint16_t tKALMAN_push(tKALMAN* ptKalman, uint16_t u16Sample);
+
+void tDECIM_init(tDECIM* ptDecim, uint8_t u8Bits, uint16_t u16Samples);
+uint8_t tDECIM_push(tDECIM* ptDecim, const uint16_t *pu16Block, uint16_t u16Count);
+
+#endif
@@ -0,0 +1,438 @@
+// Host benchmark for ADC_FILTER (not for the MSP430)
+// Build: gcc -O2 -o adc_filter_bench ADC_FILTER_BENCH.c ADC_FILTER.c -lm
+// Usage: ./adc_filter_bench [samples] [noise.txt]
+//
+// noise.txt: recorded ADC codes of a constant input, one per line, used as
+// the noise of the boxcar / Kalman comparison instead of the synthetic one
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define host_cycles() __rdtsc()
+#else
+#define host_cycles() 0ULL
+#endif
+#include "ADC_FILTER.h"
+
+#define FILTER_SIZE 200
+#define FILTER_SIZE_POW2 256
+#define SPIKE_EVERY 97          // One conversion in this many is a full scale spike
+#define STEP_LSB 100            // Kalman comparison: input step
+#define STEP_AT 1000            // Samples at the old level before it
+#define STEP_LEN 600            // Samples followed after it
+#define STEP_TRIALS 200
+#define DECIM_TRIALS 4096       // Oversampling: inputs spread over one LSB
+
+// Per-sample re-sum, as the ADC12 ISR did before ADC_FILTER
+static uint16_t resum_buffer[FILTER_SIZE];
+static uint16_t resum_index = 0;
+static uint8_t resum_full = 0;
+static uint16_t resum_avg = 0;
+
+static uint16_t resum_push(uint16_t value)
+{
+    resum_buffer[resum_index] = value;
+    resum_index++;
+    if (resum_index >= FILTER_SIZE) {
+        resum_index = 0;
+        resum_full = 1;
+    }
+
+    if (resum_full)
+    {
+        uint32_t sum = 0;
+        uint16_t i;
+        for (i = 0; i < FILTER_SIZE; i++)
+            sum += resum_buffer[i];
+        resum_avg = sum / FILTER_SIZE;
+    }
+
+    return resum_avg;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Robust stage ahead of the N=200 average: host time and TSC cycles per
+// sample, and the mean error of the average against the plain average of
+// the spike-free samples (LSB)
+static double bench_robust(const char *name, uint8_t mode, uint8_t size,
+                           const uint16_t *clean, const uint16_t *spiky, uint32_t n)
+{
+    uint16_t buf[FILTER_SIZE], buf_ref[FILTER_SIZE];
+    tFILTER filter, ref;
+    uint32_t i, count = 0;
+    double err = 0.0;
+    volatile uint32_t sink = 0;
+    unsigned long long c0;
+    double t0, t, c;
+
+    tFILTER_init(&filter, buf, FILTER_SIZE);
+    tFILTER_robust(&filter, mode, size);
+
+    t0 = now_ns();
+    c0 = host_cycles();
+    for (i = 0; i < n; i++)
+        sink += tFILTER_push(&filter, spiky[i]);
+    c = (double)(host_cycles() - c0);
+    t = now_ns() - t0;
+
+    tFILTER_rst(&filter);
+    tFILTER_init(&ref, buf_ref, FILTER_SIZE);
+    for (i = 0; i < n; i++)
+    {
+        uint16_t a = tFILTER_push(&filter, spiky[i]);
+        uint16_t b = tFILTER_push(&ref, clean[i]);
+
+        if (filter.u8Full)
+        {
+            err += (double)a - (double)b;
+            count++;
+        }
+    }
+    err = count ? err / count : 0.0;
+
+    printf("%-19s: %8.2f ns/sample %7.1f cycles/sample  spike error %6.2f LSB\n",
+           name, t / n, c / n, err);
+    return err < 0.0 ? -err : err;
+}
+
+// Samples after the step until the rms error over the trials stays below tol
+static uint32_t step_latency(const double *err2, double tol)
+{
+    uint32_t i, last = 0;
+
+    for (i = 0; i < STEP_LEN; i++)
+        if (sqrt(err2[i] / STEP_TRIALS) > tol)
+            last = i + 1;
+    return last;
+}
+
+// Boxcar against the Kalman estimate on the same noise: the output noise at
+// a constant input with Q/R picked for the noise of the N=FILTER_SIZE
+// boxcar, and the samples after a step until the rms error over the
+// trials stays below twice that. Converged, the Kalman filter is no faster
+// than the boxcar, it only has to stay within 25% of it. The latency gain
+// needs tKALMAN_rst at the step, as mppt_algorithm does on a duty change:
+// then it averages only samples of the new level. Variances in Q16 here,
+// the raw conversions are too noisy for Q24.
+static uint32_t bench_kalman(const int16_t *noise, uint32_t n)
+{
+    static double err2[3][STEP_LEN];
+    uint16_t buf[FILTER_SIZE];
+    tFILTER box;
+    tKALMAN kal, rst;
+    double var = 0.0, sum_b = 0.0, sum2_b = 0.0, sum_k = 0.0, sum2_k = 0.0, sd_b, sd_k;
+    double k = 2.0 / (FILTER_SIZE + 1), t0, t_box, t_kal;
+    uint32_t lat_box, lat_kal, lat_rst;
+    uint32_t i, j, count = 0, failed = 0, q, r;
+    volatile uint32_t sink = 0;
+
+    for (i = 0; i < n; i++)
+        var += (double)noise[i] * noise[i];
+    var /= n;
+
+    // Same white noise variance as the boxcar: K / (2 - K) = 1 / N, and
+    // the steady state gain of a random walk Kalman filter has Q / R = K^2 / (1 - K)
+    r = (uint32_t)(var * 65536.0 + 0.5);
+    q = (uint32_t)(var * 65536.0 * k * k / (1.0 - k) + 0.5);
+
+    tFILTER_init(&box, buf, FILTER_SIZE);
+    tKALMAN_init(&kal, q, r);
+
+    t0 = now_ns();
+    for (i = 0; i < n; i++)
+        sink += tFILTER_push(&box, (uint16_t)(2048 + noise[i]));
+    t_box = now_ns() - t0;
+
+    t0 = now_ns();
+    for (i = 0; i < n; i++)
+        sink += tKALMAN_push(&kal, (uint16_t)(2048 + noise[i]));
+    t_kal = now_ns() - t0;
+
+    // Output noise at a constant input, both converged
+    tFILTER_rst(&box);
+    tKALMAN_init(&kal, q, r);
+    for (i = 0; i < n; i++)
+    {
+        double b = tFILTER_push(&box, (uint16_t)(2048 + noise[i]));
+        double c = tKALMAN_push(&kal, (uint16_t)(2048 + noise[i]));
+
+        if (i >= 4 * FILTER_SIZE)
+        {
+            sum_b += b; sum2_b += b * b;
+            sum_k += c; sum2_k += c * c;
+            count++;
+        }
+    }
+    sd_b = sqrt(sum2_b / count - (sum_b / count) * (sum_b / count));
+    sd_k = sqrt(sum2_k / count - (sum_k / count) * (sum_k / count));
+
+    for (j = 0; j < STEP_TRIALS; j++)
+    {
+        tFILTER_rst(&box);
+        tKALMAN_init(&kal, q, r);
+        tKALMAN_init(&rst, q, r);
+        for (i = 0; i < STEP_AT + STEP_LEN; i++)
+        {
+            uint16_t x = (uint16_t)(2048 + (i >= STEP_AT ? STEP_LSB : 0) +
+                                    noise[(j * (STEP_AT + STEP_LEN) + i) % n]);
+            double b, c, d;
+
+            if (i == STEP_AT)
+                tKALMAN_rst(&rst);
+            b = tFILTER_push(&box, x);
+            c = tKALMAN_push(&kal, x);
+            d = tKALMAN_push(&rst, x);
+
+            if (i >= STEP_AT)
+            {
+                b -= 2048 + STEP_LSB;
+                c -= 2048 + STEP_LSB;
+                d -= 2048 + STEP_LSB;
+                err2[0][i - STEP_AT] += b * b;
+                err2[1][i - STEP_AT] += c * c;
+                err2[2][i - STEP_AT] += d * d;
+            }
+        }
+    }
+    lat_box = step_latency(err2[0], 2.0 * sd_b);
+    lat_kal = step_latency(err2[1], 2.0 * sd_b);
+    lat_rst = step_latency(err2[2], 2.0 * sd_b);
+
+    printf("\nboxcar N=%d against Kalman, input noise %.1f LSB rms, %d LSB step\n",
+           FILTER_SIZE, sqrt(var), STEP_LSB);
+    printf("boxcar             : %8.2f ns/sample  noise %5.2f LSB  %4u samples to 2 sigma\n",
+           t_box / n, sd_b, lat_box);
+    printf("kalman             : %8.2f ns/sample  noise %5.2f LSB  %4u samples to 2 sigma\n",
+           t_kal / n, sd_k, lat_kal);
+    printf("kalman, restarted  :                               %4u samples to 2 sigma\n", lat_rst);
+    printf("state              : %u bytes against %u\n", (unsigned)sizeof(tKALMAN),
+           (unsigned)(sizeof(tFILTER) + sizeof(buf)));
+
+    // The same noise, no slower converged, and a restarted estimate well
+    // ahead of the boxcar
+    if (sd_k > 1.2 * sd_b) failed++;
+    if (lat_kal * 4 > lat_box * 5) failed++;
+    if (lat_rst * 2 > lat_box) failed++;
+    printf("kalman failures    : %u\n", failed);
+    return failed;
+}
+
+static double gauss(void)
+{
+    double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+    return sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+}
+
+// Oversampling and decimation by 4^n: effective bits of the output against
+// inputs spread evenly over one LSB, each converted 4^n times with
+// gaussian noise of sd LSB. An ideal 12-bit converter has an rms error of
+// 1/sqrt(12) LSB, 12 - log2(rms * sqrt(12)) bits. Each n needs noise to
+// dither the conversions, without it the extra bits are all zero.
+static uint32_t bench_decim(double sd)
+{
+    static uint16_t block[1 << (2 * DECIM_BITS_MAX)];
+    double bits[DECIM_BITS_MAX + 1];
+    uint32_t failed = 0, trial;
+    uint8_t n;
+
+    for (n = 0; n <= DECIM_BITS_MAX; n++)
+    {
+        uint16_t count = (uint16_t)(1U << (2 * n)), j;
+        double err2 = 0.0;
+        tDECIM decim;
+
+        tDECIM_init(&decim, n, count);
+        for (trial = 0; trial < DECIM_TRIALS; trial++)
+        {
+            double x = 2048.0 + (trial + 0.5) / DECIM_TRIALS;
+
+            for (j = 0; j < count; j++)
+                block[j] = (uint16_t)lround(x + sd * gauss());
+
+            tDECIM_push(&decim, block, count);
+
+            err2 += (decim.u16Out / (double)(1U << n) - x) * (decim.u16Out / (double)(1U << n) - x);
+        }
+        bits[n] = 12.0 - log2(sqrt(err2 / DECIM_TRIALS) * sqrt(12.0));
+        printf("noise %.1f LSB, n=%u : %4u conversions  %5.2f bits\n", sd, n, count, bits[n]);
+
+        // With dither every 4x more conversions is nearly a bit more
+        if (sd > 0.0 && n > 0 && bits[n] < bits[n - 1] + 0.7)
+            failed++;
+    }
+    if (sd > 0.0 && bits[DECIM_BITS_MAX] < 14.0)
+        failed++;
+    return failed;
+}
+
+// tDECIM_init rounds the conversions per output up to a power of two of at
+// least 4^n, and a sum that spans blocks of another length carries over
+static uint32_t bench_decim_init(void)
+{
+    static const uint16_t cases[][3] = {    // bits, samples asked, samples set
+        { 0, 0, 1 }, { 0, 32, 32 }, { 2, 0, 16 }, { 2, 24, 32 },
+        { 4, 100, 256 }, { 9, 0, 256 }, { 0, 65535, DECIM_SAMPLES_MAX },
+    };
+    uint16_t block[24];
+    uint32_t failed = 0, outputs = 0;
+    tDECIM decim;
+    uint8_t c;
+    uint16_t j;
+
+    for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    {
+        tDECIM_init(&decim, (uint8_t)cases[c][0], cases[c][1]);
+        if (decim.u16Samples != cases[c][2])
+        {
+            printf("tDECIM_init(%u, %u): %u conversions, expected %u\n",
+                   cases[c][0], cases[c][1], decim.u16Samples, cases[c][2]);
+            failed++;
+        }
+    }
+
+    // 14-bit outputs of 32 conversions from blocks of 24, all 1000 LSB
+    tDECIM_init(&decim, 2, 24);
+    for (j = 0; j < 24; j++)
+        block[j] = 1000;
+    for (c = 0; c < 4; c++)
+    {
+        if (tDECIM_push(&decim, block, 24))
+        {
+            outputs++;
+            if (decim.u16Out != 4000)
+                failed++;
+        }
+    }
+    if (outputs != 3)
+        failed++;
+
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t n = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 2000000;
+    uint16_t *samples = malloc(n * sizeof(uint16_t));
+    uint16_t *spiky = malloc(n * sizeof(uint16_t));
+    int16_t *noise = malloc(n * sizeof(int16_t));
+    uint16_t buf[FILTER_SIZE];
+    uint16_t buf_pow2[FILTER_SIZE_POW2];
+    tFILTER filter, filter_pow2;
+    uint32_t i, mismatches = 0, failed = 0, decim_failed;
+    double raw_err;
+    volatile uint32_t sink = 0;
+    double t0, t_resum, t_run, t_pow2;
+
+    if (!samples || !spiky || !noise)
+        return 1;
+
+    // 12-bit readings around mid scale with switching-ripple sized noise
+    srand(1);
+    for (i = 0; i < n; i++)
+        samples[i] = (uint16_t)(2048 + (rand() % 401) - 200);
+
+    for (i = 0; i < n; i++)
+        noise[i] = (int16_t)(samples[i] - 2048);
+
+    // Recorded noise, repeated to n samples around its own mean
+    if (argc > 2)
+    {
+        FILE *f = fopen(argv[2], "r");
+        uint32_t m = 0;
+        double mean = 0.0;
+        int v;
+
+        if (!f)
+        {
+            fprintf(stderr, "cannot open %s\n", argv[2]);
+            return 2;
+        }
+        while (m < n && fscanf(f, "%d", &v) == 1)
+        {
+            noise[m++] = (int16_t)v;
+            mean += v;
+        }
+        fclose(f);
+        if (m == 0)
+            return 2;
+        mean /= m;
+        for (i = 0; i < n; i++)
+            noise[i] = (int16_t)lround((i < m ? noise[i] : noise[i % m] + mean) - mean);
+    }
+
+    // Single conversions hit by a full scale spike
+    for (i = 0; i < n; i++)
+        spiky[i] = ((i + 1) % SPIKE_EVERY) ? samples[i] : 4095;
+
+    tFILTER_init(&filter, buf, FILTER_SIZE);
+    tFILTER_init(&filter_pow2, buf_pow2, FILTER_SIZE_POW2);
+
+    t0 = now_ns();
+    for (i = 0; i < n; i++)
+        sink += resum_push(samples[i]);
+    t_resum = now_ns() - t0;
+
+    t0 = now_ns();
+    for (i = 0; i < n; i++)
+        sink += tFILTER_push(&filter, samples[i]);
+    t_run = now_ns() - t0;
+
+    t0 = now_ns();
+    for (i = 0; i < n; i++)
+        sink += tFILTER_push(&filter_pow2, samples[i]);
+    t_pow2 = now_ns() - t0;
+
+    // Both implementations must agree sample for sample
+    resum_index = 0;
+    resum_full = 0;
+    resum_avg = 0;
+    tFILTER_rst(&filter);
+    for (i = 0; i < FILTER_SIZE; i++)
+        resum_buffer[i] = 0;
+    for (i = 0; i < n; i++) {
+        if (resum_push(samples[i]) != tFILTER_push(&filter, samples[i]))
+            mismatches++;
+    }
+
+    printf("samples            : %u\n", n);
+    printf("re-sum (N=%d)     : %8.2f ns/sample\n", FILTER_SIZE, t_resum / n);
+    printf("running sum (N=%d): %8.2f ns/sample  (%.1fx)\n", FILTER_SIZE, t_run / n, t_resum / t_run);
+    printf("running sum (N=%d): %8.2f ns/sample  (%.1fx, shift)\n", FILTER_SIZE_POW2, t_pow2 / n, t_resum / t_pow2);
+    printf("mismatches         : %u\n", mismatches);
+
+    // Spike rejection, one spike in SPIKE_EVERY conversions
+    printf("\nrobust stages, N=%d average, 1 in %d conversions a spike\n", FILTER_SIZE, SPIKE_EVERY);
+    raw_err = bench_robust("raw", FILTER_RAW, 0, samples, spiky, n);
+
+    // A robust stage has to take out most of the bias
+    failed += bench_robust("median 3", FILTER_MEDIAN, 3, samples, spiky, n) * 5.0 > raw_err;
+    failed += bench_robust("median 5", FILTER_MEDIAN, 5, samples, spiky, n) * 5.0 > raw_err;
+    failed += bench_robust("hampel 3", FILTER_HAMPEL, 3, samples, spiky, n) * 5.0 > raw_err;
+    failed += bench_robust("hampel 5", FILTER_HAMPEL, 5, samples, spiky, n) * 5.0 > raw_err;
+    printf("robust failures    : %u\n", failed);
+
+    failed += bench_kalman(noise, n);
+
+    printf("\noversampling and decimation, tDECIM\n");
+    bench_decim(0.0);
+    decim_failed = bench_decim(0.5) + bench_decim(1.0) + bench_decim_init();
+    printf("decim failures     : %u\n", decim_failed);
+    failed += decim_failed;
+
+    free(samples);
+    free(spiky);
+    free(noise);
+    return (mismatches || failed) ? 1 : 0;
+}
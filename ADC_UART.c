@@ -1,5 +1,6 @@
 #include <msp430.h>
 #include <stdint.h>
+#include "ADC_FILTER.h"
 #define FILTER_SIZE 200
 
 volatile float voltage = 0;
@@ -10,9 +11,11 @@ void uart_send_string(const char *str);
 void uart_send_char(char c);
 void send_voltage_ascii(float v);
 
-volatile uint16_t adc_buffer[FILTER_SIZE] = {0}; 
-volatile uint8_t buffer_index = 0;
-volatile uint8_t buffer_full = 0; 
+// Only the ISR touches the filter, the main loop reads the copies below
+uint16_t adc_buffer[FILTER_SIZE];
+tFILTER filter;
+volatile uint16_t adc_raw = 0;
+volatile uint8_t buffer_full = 0;
 
 int main(void)
 {
@@ -34,6 +37,7 @@ int main(void)
     PM5CTL0 &= ~LOCKLPM5;
 
     uart_init();                              // Setup UART
+    tFILTER_init(&filter, adc_buffer, FILTER_SIZE);
 
     
     while(REFCTL0 & REFGENBUSY);              
@@ -58,7 +62,7 @@ int main(void)
         
         if (buffer_full) {
             uart_send_string("Raw ADC = ");
-            send_voltage_ascii((float)adc_buffer[buffer_index == 0 ? FILTER_SIZE-1 : buffer_index-1]);
+            send_voltage_ascii((float)adc_raw);
             uart_send_string(", Vout = ");
             send_voltage_ascii(Vout);
             uart_send_string("V, Voltage = ");
@@ -148,25 +152,12 @@ void __attribute__ ((interrupt(ADC12_VECTOR))) ADC12_ISR (void)
         case ADC12IV_ADC12INIFG:  break;
         case ADC12IV_ADC12IFG0:                 
         {
-            
-            adc_buffer[buffer_index] = ADC12MEM0;
-            buffer_index++;
-            
-            if (buffer_index >= FILTER_SIZE) {
-                buffer_index = 0;
-                buffer_full = 1; 
-            }
-
-            
-            if (buffer_full) {
-                
-                uint32_t sum = 0;
-                uint8_t i;
-                for (i = 0; i < FILTER_SIZE; i++) {
-                    sum += adc_buffer[i];
-                }
-                uint16_t avg_adc = sum / FILTER_SIZE;
+            uint16_t value = ADC12MEM0;
+            uint16_t avg_adc = tFILTER_push(&filter, value);
 
+            adc_raw = value;
+            buffer_full = filter.u8Full;
+            if (filter.u8Full) {
                 Vout = (avg_adc * 2.5f) / 4096.0f;
 
                 
@@ -0,0 +1,89 @@
+#include "AUTOTUNE.h"
+#include <math.h>
+
+void tune_start(tTUNE* ptTune)
+{
+    ptTune->i8Relay = 1;
+    ptTune->u16Steps = 0;
+    ptTune->u16LastUp = 0;
+    ptTune->u8Ups = 0;
+    ptTune->u32PeriodSum = 0;
+    ptTune->i32Max = INT32_MIN;
+    ptTune->i32Min = INT32_MAX;
+    ptTune->u8State = TUNE_RUNNING;
+}
+
+// One control step, returns the duty (Q24). Holds qBias once it has
+// finished, until the caller installs the new gains.
+int32_t tune_step(tTUNE* ptTune, int32_t i32ErrorMv)
+{
+    if (ptTune->u8State != TUNE_RUNNING)
+        return ptTune->qBias;
+
+    ptTune->u16Steps++;
+
+    // Error = reference - output, a positive error needs more duty
+    if (ptTune->i8Relay < 0 && i32ErrorMv > ptTune->i32HystMv)
+    {
+        ptTune->i8Relay = 1;
+        ptTune->u8Ups++;
+
+        if (ptTune->u8Ups > TUNE_SKIP + 1)
+            ptTune->u32PeriodSum += (uint16_t)(ptTune->u16Steps - ptTune->u16LastUp);
+        ptTune->u16LastUp = ptTune->u16Steps;
+
+        if (ptTune->u8Ups > TUNE_SKIP + ptTune->u8Cycles)
+            ptTune->u8State = TUNE_DONE;
+    }
+    else if (ptTune->i8Relay > 0 && i32ErrorMv < -ptTune->i32HystMv)
+    {
+        ptTune->i8Relay = -1;
+    }
+
+    // Amplitude over whole measured periods only
+    if (ptTune->u8Ups > TUNE_SKIP && ptTune->u8State == TUNE_RUNNING)
+    {
+        if (i32ErrorMv > ptTune->i32Max) ptTune->i32Max = i32ErrorMv;
+        if (i32ErrorMv < ptTune->i32Min) ptTune->i32Min = i32ErrorMv;
+    }
+
+    if (ptTune->u8State == TUNE_RUNNING && ptTune->u16Steps >= ptTune->u16MaxSteps)
+        ptTune->u8State = TUNE_FAILED;
+
+    if (ptTune->u8State != TUNE_RUNNING)
+        return ptTune->qBias;
+
+    return ptTune->i8Relay > 0 ? ptTune->qBias + ptTune->qAmp : ptTune->qBias - ptTune->qAmp;
+}
+
+// Ultimate gain (duty per volt) and period (s) from a finished experiment,
+// 0 if it failed. The hysteresis is taken out of the amplitude.
+uint8_t tune_result(const tTUNE* ptTune, float fDtSec, float *pfKu, float *pfTu)
+{
+    float a, d, e, a2;
+
+    if (ptTune->u8State != TUNE_DONE || ptTune->i32Max <= ptTune->i32Min)
+        return 0;
+
+    a = (ptTune->i32Max - ptTune->i32Min) * 0.0005f;          // Half peak to peak, V
+    e = ptTune->i32HystMv * 0.001f;
+    d = ptTune->qAmp / 16777216.0f;
+    a2 = a * a - e * e;
+    if (a2 <= 0.0f)
+        return 0;
+
+    *pfKu = 4.0f * d / (3.14159265f * sqrtf(a2));
+    *pfTu = (float)ptTune->u32PeriodSum / ptTune->u8Cycles * fDtSec;
+    return 1;
+}
+
+// Tyreus-Luyben PI, Kp = Ku / 3.2 and Ti = 2.2 Tu, in the form of tPI_calc
+// (Ki = 1 / Ti). Ziegler-Nichols (0.45 Ku, 1.2 / Tu) overshoots the boost on load steps.
+// 0 if the gains do not fit the Q24 tPIQ, which stops below 128.
+uint8_t tune_gains(float fKu, float fTu, float *pfKp, float *pfKi)
+{
+    *pfKp = fKu / 3.2f;
+    *pfKi = 1.0f / (2.2f * fTu);
+
+    return *pfKp > 0.0f && *pfKp < 127.0f && *pfKi > 0.0f && *pfKi < 127.0f;
+}
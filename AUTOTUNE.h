@@ -0,0 +1,42 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <stdint.h>
+
+// Relay feedback (Astrom-Hagglund) auto-tuning of the tPI/tPIQ gains.
+// tune_step() replaces the PI in the control ISR: it switches the duty
+// between qBias + qAmp and qBias - qAmp on the sign of the error, which
+// makes the loop oscillate at its ultimate period Tu with an amplitude a.
+// The ultimate gain is Ku = 4d / (pi a), tune_gains() turns both into PI
+// gains outside the ISR. Integer only in the ISR.
+
+#define TUNE_IDLE       0
+#define TUNE_RUNNING    1
+#define TUNE_DONE       2
+#define TUNE_FAILED     3
+
+#define TUNE_SKIP       2       // Oscillation periods dropped while it settles
+
+typedef struct {
+    int32_t qBias;              // Relay centre, near the steady-state duty (Q24)
+    int32_t qAmp;               // Relay amplitude d (Q24)
+    int32_t i32HystMv;          // Relay hysteresis on the error (mV), above the noise
+    uint8_t u8Cycles;           // Oscillation periods measured after TUNE_SKIP
+    uint16_t u16MaxSteps;       // Gives up after this many calls
+
+    volatile uint8_t u8State;   // TUNE_IDLE, TUNE_RUNNING, TUNE_DONE or TUNE_FAILED, shared with the ISR
+    int8_t i8Relay;             // +1 or -1
+    uint16_t u16Steps;
+    uint16_t u16LastUp;         // Step of the last switch to +1
+    uint8_t u8Ups;              // Switches to +1 so far
+    uint32_t u32PeriodSum;      // Measured periods (steps)
+    int32_t i32Max;             // Error extremes over the measured periods (mV)
+    int32_t i32Min;
+} tTUNE;
+
+void tune_start(tTUNE* ptTune);
+int32_t tune_step(tTUNE* ptTune, int32_t i32ErrorMv);
+uint8_t tune_result(const tTUNE* ptTune, float fDtSec, float *pfKu, float *pfTu);
+uint8_t tune_gains(float fKu, float fTu, float *pfKp, float *pfKi);
+
+#endif
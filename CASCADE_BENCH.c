@@ -0,0 +1,71 @@
+// Irradiance transients with the MPPT driving the duty directly (MPPT.c)
+// and as the outer loop of a PV voltage PI (MPPT_PI.c), both closed loop
+// against PV_SIM with the firmware timing. The cascade has to come back
+// to within 5% of the MPP sooner and collect at least as much energy.
+//
+// Build: gcc -O2 -o cascade_bench CASCADE_BENCH.c SIM_LOOP.c PV_SIM.c MPPT_CTRL.c PI.c ADC_FILTER.c SENSOR.c AUTOTUNE.c MPC.c -lm
+// Returns nonzero if any transient fails.
+
+#include <stdio.h>
+#include "SIM_LOOP.h"
+
+typedef struct {
+    const char *pcName;
+    tSIM_PROFILE tIrradiance;
+} tTRANSIENT;
+
+// Each starts at 60s, after both controllers have settled
+static const tTRANSIENT transients[] = {
+    { "step 1000 -> 700",      { 2, { 60.0, 60.5 }, { 1000.0, 700.0 } } },
+    { "step 700 -> 1000",      { 3, { 0.0, 60.0, 60.5 }, { 700.0, 700.0, 1000.0 } } },
+    { "step 1000 -> 800",      { 2, { 60.0, 60.5 }, { 1000.0, 800.0 } } },
+    { "ramp 1000 -> 700, 10s", { 2, { 60.0, 70.0 }, { 1000.0, 700.0 } } },
+    { "cloud 1000/700/1000",   { 4, { 60.0, 61.0, 66.0, 67.0 }, { 1000.0, 700.0, 700.0, 1000.0 } } },
+};
+#define NTRANSIENTS (sizeof(transients) / sizeof(transients[0]))
+
+static void run(const tTRANSIENT* ptTransient, uint8_t u8Mode, tSIM_RESULT* ptResult)
+{
+    tSIM_CFG cfg;
+
+    if (u8Mode == SIM_MODE_CASCADE)
+        sim_default_cascade(&cfg);
+    else
+        sim_default_mppt(&cfg);
+
+    cfg.dDuration = 120.0;
+    cfg.tMpptSet.u8Mode = MPPT_MODE_INCCOND;
+    cfg.tIrradiance = ptTransient->tIrradiance;
+    sim_run(&cfg, ptResult, 0);
+}
+
+int main(void)
+{
+    tSIM_RESULT duty, cascade;
+    int fails = 0;
+    unsigned c;
+
+    printf("%-24s %21s %21s\n", "", "duty (MPPT.c)", "cascade (MPPT_PI.c)");
+    printf("%-24s %10s %10s %10s %10s\n", "transient", "below 95%", "energy", "below 95%", "energy");
+
+    for (c = 0; c < NTRANSIENTS; c++)
+    {
+        run(&transients[c], SIM_MODE_MPPT, &duty);
+        run(&transients[c], SIM_MODE_CASCADE, &cascade);
+
+        printf("%-24s %9.3fs %9.2f%% %9.3fs %9.2f%%\n", transients[c].pcName,
+               duty.dRecoverTime, duty.dEfficiency * 100.0,
+               cascade.dRecoverTime, cascade.dEfficiency * 100.0);
+
+        if ((duty.dRecoverTime > 0.0 && cascade.dRecoverTime >= duty.dRecoverTime) ||
+            cascade.dEfficiency < duty.dEfficiency)
+        {
+            printf("  FAIL: cascade %s\n", cascade.dEfficiency < duty.dEfficiency ?
+                   "collected less energy" : "did not recover sooner");
+            fails++;
+        }
+    }
+
+    printf("%d of %u transients failed\n", fails, (unsigned)NTRANSIENTS);
+    return fails ? 1 : 0;
+}
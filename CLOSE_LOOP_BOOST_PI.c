@@ -1,137 +1,351 @@
-#include <msp430.h>
 #include <stdint.h>
+#include "HAL.h"
+#include "ADC_FILTER.h"
+#include "AUTOTUNE.h"
+#include "MPC.h"
+#include "PI.h"
+#include "SENSOR.h"
+#include "TELEMETRY.h"
 
 #define FILTER_SIZE 10
+#define FILTER_ROBUST FILTER_RAW    // FILTER_MEDIAN or FILTER_HAMPEL: spike rejection ahead of the average, adds ROBUST_SIZE / 2 samples of delay in the loop
+#define ROBUST_SIZE 3
 #define VREF 75.0f         // Desired output voltage
+#define VREF_MV 75000L     // Desired output voltage (mV), fixed point controller
+#define PWM_CCR0 19        // 50kHz PWM at 1MHz SMCLK
+#define PI_FIXED 1         // 1: run the fixed point tPIQ in the ISR, 0: float tPI
+#define CONTROL_ISR 1      // 1: PI step every CONTROL_DECIM PWM periods in the ADC ISR, 0: once per LOOP_MS
+#define CONTROL_MPC 0      // 1: finite control set MPC (MPC.h) on Vout and the inductor current (A7) instead of the PI
+#if CONTROL_MPC
+#define CONTROL_DECIM 10   // 5kHz, the output LC resonance (~620Hz) is too close to 1kHz for the MPC model
+#else
+#define CONTROL_DECIM 50   // PWM periods per control step, 5..50 for 10kHz..1kHz
+#endif
+#define CONTROL_DT (CONTROL_DECIM * (PWM_CCR0 + 1) / 1000000.0f)  // Control period (s), SMCLK 1MHz
+#define LOOP_MS 500        // Main loop period, HAL_DELAY_CYCLES(500000) at 1MHz
+#define PI_FEEDFORWARD 1   // 1: add the ideal boost duty 1 - Vin/VREF to the PI output
+#define VIN_SENSE 0        // 1: input voltage on A7 through a second 772 divider, 0: VIN_MV
+#define VIN_MV 50000L      // Nominal input voltage (mV) when it is not measured
+#define PI_AUTOTUNE 1      // 1: relay auto-tune when no gains are stored and on a 't' from the UART
+#define AUTOTUNE_AMP 0.1f  // Relay duty step around the boost duty
+#define AUTOTUNE_HYST_MV 1000   // Relay hysteresis, above the filtered ADC noise
+#define AUTOTUNE_CYCLES 4  // Oscillation periods averaged
+#define AUTOTUNE_STEPS 5000     // Control steps before it gives up, 5s at 1kHz
+#define GAINS_MAGIC 0x504A // Marks a gains record in the NV area, Ki = 1 / Ti
+#define MPC_L 2e-3f        // Boost inductor (H), the MPC model
+#define MPC_COUT 15e-6f    // Output capacitor (F)
+
+#if VIN_SENSE && !CONTROL_ISR
+#error VIN_SENSE needs the A10/A7 pairs of CONTROL_ISR
+#endif
+#if PI_AUTOTUNE && !CONTROL_ISR
+#error PI_AUTOTUNE needs the control rate of CONTROL_ISR
+#endif
+#if CONTROL_MPC && !CONTROL_ISR
+#error CONTROL_MPC needs the A10/A7 pairs of CONTROL_ISR
+#endif
+#if CONTROL_MPC && (VIN_SENSE || PI_AUTOTUNE)
+#error CONTROL_MPC takes A7 for the inductor current and replaces the PI, set VIN_SENSE and PI_AUTOTUNE to 0
+#endif
 
-// PI Controller
-typedef struct {
-    float fIn;         // Error 
-    float fKp;         // Proportional gain
-    float fKi;         // Integral gain
-    float fDtSec;     
-
-    float fPout;       // Proportional output
-    float fIout;       // Integral output
-    float fIprevIn;    // Previous proportional output (for integration)
-    float fIprevOut;   // Previous integral output
-
-    float fOut;        // Controller output (duty cycle)
-    float fUpOutLim;   // Upper output limit (e.g., 1.0)
-    float fLowOutLim;  // Lower output limit (e.g., 0.0)
-} tPI;
+#if CONTROL_ISR
+#define MCLK_MHZ 8         // CPU at 8MHz for the ISR, SMCLK and the PWM stay at 1MHz
+#define PI_KP 0.01f
+#define PI_KI 10.5f
+#define PI_DT CONTROL_DT
+#else
+#define MCLK_MHZ 1
+#define PI_KP 0.05f
+#define PI_KI 0.5f
+#define PI_DT 0.5f
+#endif
+#define TELEMETRY_BINARY 1 // 1: COBS framed binary samples (TELEMETRY.h), 0: ASCII lines
+#define TELEMETRY_MAX 64   // Longest status line, only queued when it fits whole
 
 
-void uart_init(void);
 void uart_send_string(const char *str);
 void uart_send_char(char c);
 void send_voltage_ascii(float v);
-void pwm_init(void);
-void tPI_calc(tPI* ptPI);
-void tPI_rst(tPI* ptPI);
+#if CONTROL_MPC
+static void mpc_pair_isr(uint16_t vout, uint16_t il);
+#elif VIN_SENSE
+static void adc_pair_isr(uint16_t vout, uint16_t vin);
+#else
+static void adc_isr(uint8_t channel, uint16_t value);
+#endif
+#if !CONTROL_MPC
+static void control_step(uint16_t value, int32_t vin_mv);
+#endif
+static uint16_t filter_push(uint16_t value);
+static void gains_install(float kp, float ki, int32_t qBias);
+#if PI_AUTOTUNE
+static void autotune_start(void);
+static void autotune_finish(void);
+#endif
 
 
 volatile float voltage = 0;
 volatile float Vout = 0;
 volatile float duty_cycle = 0;
-
-volatile uint16_t adc_buffer[FILTER_SIZE] = {0};
-volatile uint8_t buffer_index = 0;
+volatile int32_t voltage_mv = 0;
+volatile uint16_t duty_counts = 0;
+volatile int32_t input_mv = VIN_MV;
+uint32_t time_ms = 0;
+
+tTELEM telem;
+uint8_t telem_buf[TELEM_FRAME_MAX];
+
+// Only the ISR touches the filter, the main loop reads the copies below
+uint16_t adc_buffer[FILTER_SIZE];
+tFILTER filter;
+volatile uint16_t adc_raw = 0;
 volatile uint8_t buffer_full = 0;
 
 // PI controller parametervalues
 tPI myPI = {
-    .fKp = 0.05f,
-    .fKi = 0.005f,
-    .fDtSec = 0.5f,         // Sampling interval in seconds
+    .fKp = PI_KP,
+    .fKi = PI_KI,
+    .fDtSec = PI_DT,        // Sampling interval in seconds
     .fUpOutLim = 0.4f,
     .fLowOutLim = 0.0f
 };
 
-void pwm_init(void)
-{
-    P1DIR |= BIT2;               
-    P1SEL0 |= BIT2;              
-    P1SEL1 &= ~BIT2;
-
-    TA1CCR0 = 19;                
-    TA1CCTL1 = OUTMOD_7;      
-    TA1CCR1 = 0;                 
-    TA1CTL = TASSEL_2 | MC_1 | TACLR;  
-}
+// Same controller in fixed point
+tPIQ myPIQ = {
+    .qKp = PI_Q24(PI_KP),
+    .qKi = PI_Q24(PI_KI),
+    .qDtSec = PI_Q24(PI_DT),
+    .qUpOutLim = PI_Q24(0.4f),
+    .qLowOutLim = PI_Q24(0.0f)
+};
 
-int main(void)
-{
-    WDTCTL = WDTPW | WDTHOLD;                 
+#if PI_AUTOTUNE
+// Relay experiment, run by the control ISR instead of the PI while active
+tTUNE tune = {
+    .qAmp = PI_Q24(AUTOTUNE_AMP),
+    .i32HystMv = AUTOTUNE_HYST_MV,
+    .u8Cycles = AUTOTUNE_CYCLES,
+    .u16MaxSteps = AUTOTUNE_STEPS
+};
 
-    // GPIO Setup for LED
-    P1OUT &= ~BIT0;                           
-    P1DIR |= BIT0;                            
+// Tuned gains as kept in the NV area, no padding on either target
+typedef struct {
+    float fKp;
+    float fKi;
+    uint16_t u16Magic;
+    uint16_t u16Crc;        // telem_crc16 of the fields above
+} tGAINS;
 
-    // Configure UART pins
-    P2SEL1 |= BIT0 | BIT1;                    
-    P2SEL0 &= ~(BIT0 | BIT1);
+tGAINS gains;
+#endif
 
-    // Configure ADC pins
-    P4SEL1 |= BIT2;                           
-    P4SEL0 |= BIT2;
+#if CONTROL_MPC
+// Averaged boost model, one step per control period
+tMPC myMPC = {
+    .i32VrefMv = VREF_MV,
+    .i32VinMv = VIN_MV,
+    .qKl = MPC_KL(CONTROL_DT, MPC_L, PWM_CCR0 + 1),
+    .qKc = MPC_KC(CONTROL_DT, MPC_COUT, PWM_CCR0 + 1),
+    .qGv = MPC_Q8(0.25f),
+    .qGo = MPC_Q16(0.02f),
+    .qWi = MPC_Q8(1.0f),
+    .i32WduMv = 300,
+    .u16Period = PWM_CCR0 + 1,
+    .u16MaxCount = (PWM_CCR0 + 1) / 2,  // Same 50% clamp as the PI
+    .u8Span = 1
+};
+#endif
 
-    
-    PM5CTL0 &= ~LOCKLPM5;
+int main(void)
+{
+    hal_init();
+    hal_uart_init();
+    hal_pwm_init(PWM_CCR0, 0);
+#if PI_AUTOTUNE
+    // Stored gains from an earlier run, otherwise tune them first
+    hal_nv_read(&gains, sizeof(gains));
+    if (gains.u16Magic == GAINS_MAGIC &&
+        gains.u16Crc == telem_crc16((const uint8_t *)&gains, sizeof(gains) - sizeof(gains.u16Crc)))
+        gains_install(gains.fKp, gains.fKi, 0);
+    else
+        autotune_start();
+#else
+    gains_install(PI_KP, PI_KI, 0);
+#endif
+    tFILTER_init(&filter, adc_buffer, FILTER_SIZE);
+    tFILTER_robust(&filter, FILTER_ROBUST, ROBUST_SIZE);
+#if CONTROL_ISR
+    // Conversions and PI steps run on their own from here, locked to the PWM
+    hal_cpu_fast();
+#if CONTROL_MPC
+    tMPC_rst(&myMPC);
+    hal_adc_timer_pair_init(mpc_pair_isr, CONTROL_DECIM);
+#elif VIN_SENSE
+    hal_adc_timer_pair_init(adc_pair_isr, CONTROL_DECIM);
+#else
+    hal_adc_timer_init(adc_isr, HAL_CH_A10, CONTROL_DECIM);
+#endif
+    // The main loop below never sleeps, so nothing else sets GIE
+    hal_irq_enable();
+#else
+    hal_adc_init(adc_isr);
+#endif
+#if TELEMETRY_BINARY
+    telem_init(&telem, TELEM_TYPE_BOOST, LOOP_MS);
+    uart_send_char(0);                    // Frame delimiter for the decoder
+#endif
+
+    while(1)
+    {
+        int32_t mv;
+#if PI_AUTOTUNE
+        int16_t c;
+#endif
 
-    uart_init();                             
-    pwm_init();                              
-    tPI_rst(&myPI);                          
+        HAL_DELAY_CYCLES(500000L * MCLK_MHZ); // 0.5 second delay
+        time_ms += LOOP_MS;
 
-    
-    while(REFCTL0 & REFGENBUSY);
-    REFCTL0 |= REFVSEL_2 | REFON;             
-    while(!(REFCTL0 & REFGENRDY));            
+#if PI_AUTOTUNE
+        // 't' retunes, the new gains replace the stored ones
+        while ((c = hal_uart_getc()) >= 0)
+            if (c == 't' && tune.u8State == TUNE_IDLE)
+                autotune_start();
 
-    // Configure ADC12
-    ADC12CTL0 = ADC12SHT0_2 | ADC12ON;
-    ADC12CTL1 = ADC12SHP;
-    ADC12CTL2 |= ADC12RES_2;                  // 12-bit resolution
-    ADC12IER0 |= ADC12IE0;
-    ADC12MCTL0 |= ADC12INCH_10 | ADC12VRSEL_1; // A10, Vref=2.5V
+        if (tune.u8State == TUNE_DONE || tune.u8State == TUNE_FAILED)
+            autotune_finish();
+#endif
+#if !CONTROL_ISR
+        hal_adc_start(HAL_CH_A10);
 
-    while(1)
-    {
-        __delay_cycles(500000);               // 0.5 second delay
-        ADC12CTL0 |= ADC12ENC | ADC12SC;      
+        hal_sleep();
+#endif
 
-        __bis_SR_register(LPM0_bits + GIE);
-        __no_operation();                     
+#if !PI_FIXED
+        voltage_mv = (int32_t)(voltage * 1000.0f);
+#endif
+        // The ISR may update the 32-bit value between the two word reads
+        do {
+            mv = voltage_mv;
+        } while (mv != voltage_mv);
 
-        
+#if TELEMETRY_BINARY
         if (buffer_full) {
+            // 8 samples per frame, dropped whole when the TX buffer is full.
+            // The current field carries the longest ADC ISR time (us).
+            if (telem_push(&telem, time_ms, mv, hal_adc_isr_max(), duty_counts)) {
+                uint16_t len = telem_frame(&telem, telem_buf);
+                uint16_t i;
+
+                if (hal_uart_tx_free() >= len)
+                    for (i = 0; i < len; i++)
+                        uart_send_char((char)telem_buf[i]);
+            }
+        }
+#else
+        if (buffer_full && hal_uart_tx_free() >= TELEMETRY_MAX) {
+#if PI_FIXED
+            // Float only for printing, outside the ISR
+            voltage = mv / 1000.0f;
+            Vout = voltage / 772.0f + 1.286f;
+#endif
             uart_send_string("Raw ADC = ");
-            send_voltage_ascii((float)adc_buffer[buffer_index == 0 ? FILTER_SIZE-1 : buffer_index-1]);
+            send_voltage_ascii((float)adc_raw);
             uart_send_string(", Vout = ");
             send_voltage_ascii(Vout);
             uart_send_string("V, Voltage = ");
             send_voltage_ascii(voltage);
-            uart_send_string(" V\r\n");
+            uart_send_string(" V, ISR = ");
+            send_voltage_ascii((float)hal_adc_isr_max());
+            uart_send_string(" us\r\n");
         }
+#endif
     }
 }
 
-void uart_init(void)
+// New gains with the integrator preset to qBias, the PI continues from
+// that duty. Only before the control ISR starts or with it masked.
+static void gains_install(float kp, float ki, int32_t qBias)
 {
-    UCA0CTLW0 = UCSWRST;                      
-    UCA0CTLW0 |= UCSSEL__SMCLK;            
+    myPI.fKp = kp;
+    myPI.fKi = ki;
+    myPIQ.qKp = PI_Q24(kp);
+    myPIQ.qKi = PI_Q24(ki);
+
+    tPI_rst(&myPI);
+    tPIQ_rst(&myPIQ);
+#if PI_FEEDFORWARD
+    // The feedforward carries the duty, the integrator only the losses
+    qBias = 0;
+#if !VIN_SENSE
+    // Constant input, the division is done once here instead of every step
+    myPI.fFf = tPI_boost_ff(VIN_MV / 1000.0f, VREF);
+    myPIQ.qFf = tPIQ_boost_ff(VIN_MV, VREF_MV);
+#endif
+#endif
+    myPI.fIout = myPI.fIprevOut = qBias / 16777216.0f;
+    myPIQ.qIout = myPIQ.qIprevOut = qBias;
+}
 
-    UCA0BR0 = 8;
-    UCA0BR1 = 0;
-    UCA0MCTLW = 0xD600;                       // 115200 baud
+#if PI_AUTOTUNE
+// Relay around the ideal boost duty, the ISR takes over on its next step
+static void autotune_start(void)
+{
+    int32_t vin;
+    uint16_t irq;
+
+    do {
+        vin = input_mv;
+    } while (vin != input_mv);
+
+    // The ISR reads the experiment as soon as u8State leaves TUNE_IDLE
+    irq = hal_irq_save();
+    tune.qBias = tPIQ_boost_ff(vin, VREF_MV);
+    tune_start(&tune);
+    hal_irq_restore(irq);
+}
+
+// Main loop side of a finished experiment: gains, NV record, PI back on.
+// A failed one keeps the previous gains.
+static void autotune_finish(void)
+{
+    float ku, tu, kp, ki;
+    uint16_t irq;
 
-    UCA0CTLW0 &= ~UCSWRST;                   
+    if (tune_result(&tune, PI_DT, &ku, &tu) && tune_gains(ku, tu, &kp, &ki))
+    {
+        gains.fKp = kp;
+        gains.fKi = ki;
+        gains.u16Magic = GAINS_MAGIC;
+        gains.u16Crc = telem_crc16((const uint8_t *)&gains, sizeof(gains) - sizeof(gains.u16Crc));
+        hal_nv_write(&gains, sizeof(gains));
+#if !TELEMETRY_BINARY
+        uart_send_string("Tuned Kp = ");
+        send_voltage_ascii(kp);
+        uart_send_string(", Ki = ");
+        send_voltage_ascii(ki);
+        uart_send_string("\r\n");
+#endif
+    }
+    else
+    {
+        kp = myPI.fKp;          // PI_KP and PI_KI if nothing was installed yet
+        ki = myPI.fKi;
+#if !TELEMETRY_BINARY
+        uart_send_string("Tuning failed\r\n");
+#endif
+    }
+
+    // The ISR runs the PI again as soon as u8State is TUNE_IDLE
+    irq = hal_irq_save();
+    gains_install(kp, ki, tune.qBias);
+    tune.u8State = TUNE_IDLE;
+    hal_irq_restore(irq);
 }
+#endif
 
 void uart_send_char(char c)
 {
-    while (!(UCA0IFG & UCTXIFG));            
-    UCA0TXBUF = c;
+    hal_uart_putc(c);
 }
 
 void uart_send_string(const char *str)
@@ -177,115 +391,105 @@ void send_voltage_ascii(float v)
     uart_send_char('0' + (frac % 10));
 }
 
-// PI Controller
+// Output voltage filter, with the copies the main loop reads
+static uint16_t filter_push(uint16_t value)
+{
+    uint16_t avg_adc = tFILTER_push(&filter, value);
 
-void tPI_calc(tPI* ptPI)
+    adc_raw = value;
+    buffer_full = filter.u8Full;
+    return avg_adc;
+}
+
+// ADC12 ISR work, called by the HAL for every conversion
+#if CONTROL_MPC
+// MPC step on every unfiltered pair, the filter only feeds the telemetry
+static void mpc_pair_isr(uint16_t vout, uint16_t il)
 {
-    float fPreOut;
+    uint16_t avg_adc = filter_push(vout);
 
-    ptPI->fPout = ptPI->fIn * ptPI->fKp;
+    myMPC.i32VoutMv = sensor_voltage_mv(vout);
+    myMPC.i32IlMa = sensor_current_ma(il);
+    tMPC_calc(&myMPC);
+    duty_counts = myMPC.u16Count;
+    hal_pwm_set(duty_counts);
 
-    
-    if ((ptPI->fOut < ptPI->fUpOutLim && ptPI->fOut > ptPI->fLowOutLim) ||
-        (ptPI->fIn < 0 && ptPI->fOut >= ptPI->fUpOutLim) ||
-        (ptPI->fIn > 0 && ptPI->fOut <= ptPI->fLowOutLim))
-    {
-        ptPI->fIout = ptPI->fIprevOut + 0.5f * ptPI->fDtSec *
-            (ptPI->fPout * ptPI->fKi + ptPI->fIprevIn);
-    }
-    else
-    {
-        ptPI->fIout = ptPI->fIprevOut; 
-    }
+    voltage_mv = sensor_voltage_mv(avg_adc);
+    hal_led_set(avg_adc >= 0x666);
+}
+#elif VIN_SENSE
+static void adc_pair_isr(uint16_t vout, uint16_t vin)
+{
+    control_step(vout, sensor_voltage_mv(vin));
+}
+#else
+static void adc_isr(uint8_t channel, uint16_t value)
+{
+    (void)channel;
+    control_step(value, VIN_MV);
+}
+#endif
 
-    ptPI->fIprevIn = ptPI->fPout;
-    ptPI->fIprevOut = ptPI->fIout;
+#if !CONTROL_MPC
+// Filter and PI step on one output voltage conversion
+static void control_step(uint16_t value, int32_t vin_mv)
+{
+    uint16_t avg_adc = filter_push(value);
 
-    fPreOut = ptPI->fPout + ptPI->fIout;
+    input_mv = vin_mv;
 
+#if PI_AUTOTUNE
+    if (filter.u8Full && tune.u8State != TUNE_IDLE) {
+        int32_t qDuty;
 
-    if (fPreOut > ptPI->fUpOutLim) fPreOut = ptPI->fUpOutLim;
-    if (fPreOut < ptPI->fLowOutLim) fPreOut = ptPI->fLowOutLim;
+        voltage_mv = sensor_voltage_mv(avg_adc);
+        qDuty = tune_step(&tune, VREF_MV - voltage_mv);
+        duty_counts = tPIQ_counts(qDuty, hal_pwm_ccr0());
+        hal_pwm_set(duty_counts);
+        return;
+    }
+#endif
 
-    ptPI->fOut = fPreOut;
-}
+    if (filter.u8Full) {
+#if PI_FIXED
+        int32_t qDuty;
+
+        voltage_mv = sensor_voltage_mv(avg_adc);
+#if PI_FEEDFORWARD && VIN_SENSE
+        myPIQ.qFf = tPIQ_boost_ff(vin_mv, VREF_MV);
+#endif
 
+        myPIQ.qIn = PI_MV_TO_Q16(VREF_MV - voltage_mv);
+        tPIQ_calc(&myPIQ);
+        qDuty = myPIQ.qOut;
 
-// PI controller reset
-void tPI_rst(tPI* ptPI)
-{
-    ptPI->fIn = 0.0f;
-    ptPI->fIout = 0.0f;
-    ptPI->fIprevIn = 0.0f;
-    ptPI->fIprevOut = 0.0f;
-    ptPI->fOut = 0.0f;
-    ptPI->fPout = 0.0f;
-}
+        if (qDuty > PI_Q24(0.5f))
+        qDuty = PI_Q24(0.5f);
 
-#if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
-#pragma vector = ADC12_VECTOR
-__interrupt void ADC12_ISR(void)
-#elif defined(__GNUC__)
-void __attribute__ ((interrupt(ADC12_VECTOR))) ADC12_ISR (void)
+        duty_counts = tPIQ_counts(qDuty, hal_pwm_ccr0());
+        hal_pwm_set(duty_counts);
 #else
-#error Compiler not supported!
+        Vout = (avg_adc * 2.5f) / 4096.0f;
+
+        voltage = 772.0f * (Vout - 1.286f);
+
+    
+#if PI_FEEDFORWARD && VIN_SENSE
+        myPI.fFf = tPI_boost_ff(vin_mv / 1000.0f, VREF);
 #endif
-{
-    switch (__even_in_range(ADC12IV, ADC12IV_ADC12RDYIFG))
-    {
-        case ADC12IV_NONE:        break;
-        case ADC12IV_ADC12OVIFG:  break;
-        case ADC12IV_ADC12TOVIFG: break;
-        case ADC12IV_ADC12HIIFG:  break;
-        case ADC12IV_ADC12LOIFG:  break;
-        case ADC12IV_ADC12INIFG:  break;
-        case ADC12IV_ADC12IFG0:                  
-        {
-            
-            adc_buffer[buffer_index] = ADC12MEM0;
-            buffer_index++;
-
-            if (buffer_index >= FILTER_SIZE) {
-                buffer_index = 0;
-                buffer_full = 1; 
-            }
+        myPI.fIn = VREF - voltage;
+        tPI_calc(&myPI);
+        duty_cycle = myPI.fOut;
+        
+        if (duty_cycle > 0.5f)
+        duty_cycle = 0.5f;
 
-            
-            if (buffer_full) {
-            
-                uint32_t sum = 0;
-                uint8_t i;
-                for (i = 0; i < FILTER_SIZE; i++) {
-                    sum += adc_buffer[i];
-                }
-                uint16_t avg_adc = sum / FILTER_SIZE;
-
-                Vout = (avg_adc * 2.5f) / 4096.0f;
-
-                voltage = 772.0f * (Vout - 1.286f);
-
-            
-                myPI.fIn = VREF - voltage;
-                tPI_calc(&myPI);
-                duty_cycle = myPI.fOut;
-                
-                if (duty_cycle > 0.5f)
-                duty_cycle = 0.5f;
-
-                
-                TA1CCR1 = (uint16_t)(duty_cycle * TA1CCR0);
-
-            
-                if (avg_adc >= 0x666)
-                    P1OUT |= BIT0;
-                else
-                    P1OUT &= ~BIT0;
-            }
+        
+        duty_counts = tPI_counts(duty_cycle, hal_pwm_ccr0());
+        hal_pwm_set(duty_counts);
+#endif
 
-            __bic_SR_register_on_exit(LPM0_bits);
-            break;
-        }
-        default: break;
+        hal_led_set(avg_adc >= 0x666);
     }
 }
-
+#endif
@@ -0,0 +1,147 @@
+// Global MPPT test set: partially shaded arrays with multi-peak P-V curves.
+// The controller is fed steady state measurements of PV_SIM at every duty it
+// asks for, and has to end its search on the global peak of the duty window
+// within u8Particles * u8SearchIter measurements.
+//
+// Build: gcc -O2 -o gmppt_bench GMPPT_BENCH.c MPPT_CTRL.c ADC_FILTER.c SENSOR.c PV_SIM.c -lm
+// Returns nonzero if any curve fails.
+
+#include <stdio.h>
+#include <string.h>
+#include "MPPT_CTRL.h"
+#include "PV_SIM.h"
+
+#define PASS_RATIO 0.98         // Power at the end of the search vs the global peak
+
+typedef struct {
+    const char *pcName;
+    tPV_SHADE tShade;
+    double dR;
+} tCURVE;
+
+// Shade pattern and load picked so the peaks sit inside the 10%..50% window
+static const tCURVE curves[] = {
+    { "uniform",                   { 0 },                                 60.0 },
+    { "1 @ 50%",                   { 1, { 1 }, { 0.5 } },                 60.0 },
+    { "1 @ 60%",                   { 1, { 1 }, { 0.6 } },                 50.0 },
+    { "2 @ 50%",                   { 1, { 2 }, { 0.5 } },                 60.0 },
+    { "2 @ 60%",                   { 1, { 2 }, { 0.6 } },                 50.0 },
+    { "2 @ 70%",                   { 1, { 2 }, { 0.7 } },                 60.0 },
+    { "3 @ 60%",                   { 1, { 3 }, { 0.6 } },                 50.0 },
+    { "3 @ 70%",                   { 1, { 3 }, { 0.7 } },                 40.0 },
+    { "4 @ 70%",                   { 1, { 4 }, { 0.7 } },                 40.0 },
+    { "2 @ 70%, 2 @ 30%",          { 2, { 2, 2 }, { 0.7, 0.3 } },         60.0 },
+    { "1 @ 60%, 2 @ 40%, 2 @ 20%", { 3, { 1, 2, 2 }, { 0.6, 0.4, 0.2 } }, 60.0 },
+};
+#define NCURVES (sizeof(curves) / sizeof(curves[0]))
+
+static tPV pv;
+static tBOOST boost;
+
+static double power_at(uint16_t u16Duty, double *pdV, double *pdI)
+{
+    double d = u16Duty / 1000.0;
+    double v = boost_steady_vin(&boost, &pv, d);
+    double i = pv_current(&pv, v, 0);
+
+    if (pdV) *pdV = v;
+    if (pdI) *pdI = i;
+    return v * i;
+}
+
+static void measure(tMPPT* ptMPPT)
+{
+    double v, i;
+
+    power_at(ptMPPT->u16Duty, &v, &i);
+    ptMPPT->i32Voltage = (int32_t)(v * 1000.0 + 0.5);
+    ptMPPT->i32Current = (int32_t)(i * 1000.0 + 0.5);
+}
+
+static void settings(tMPPT* ptMPPT, uint8_t u8Particles)
+{
+    memset(ptMPPT, 0, sizeof(*ptMPPT));
+    ptMPPT->u16DutyStep = 10;
+    ptMPPT->u16MinDuty = 100;
+    ptMPPT->u16MaxDuty = 500;
+    ptMPPT->u8Delay = 1;
+    ptMPPT->u16FilterSize = 1;
+    ptMPPT->u8Mode = MPPT_MODE_INCCOND;
+    ptMPPT->u16IncTol = 20;
+    ptMPPT->u8Particles = u8Particles;
+    ptMPPT->u8SearchIter = 10;
+    ptMPPT->u16SearchFilter = 1;
+    ptMPPT->u16SearchTrigger = 200;
+}
+
+int main(void)
+{
+    static tMPPT m;
+    unsigned c;
+    int fails = 0;
+
+    pv_init(&pv, 10, 2);
+    memset(&boost, 0, sizeof(boost));
+    boost.dRL = 0.01;
+
+    printf("%-26s %5s %9s %9s %11s %9s %6s %11s\n",
+           "curve", "peaks", "Pglobal", "duty", "PSO duty", "PSO P", "evals", "local P");
+
+    for (c = 0; c < NCURVES; c++)
+    {
+        double pbest = 0.0, p, prev = 0.0, next, ppso, plocal;
+        uint16_t d, dbest = 0, peaks = 0;
+        uint16_t k, limit, dpso, evals;
+        uint8_t done;
+
+        pv_set_shade(&pv, &curves[c].tShade);
+        boost.dR = curves[c].dR;
+
+        // Reference: every duty count of the window
+        for (d = 100; d <= 500; d++)
+        {
+            p = power_at(d, 0, 0);
+            next = d < 500 ? power_at(d + 1, 0, 0) : 0.0;
+            if (p > prev && p >= next) peaks++;
+            if (p > pbest) { pbest = p; dbest = d; }
+            prev = p;
+        }
+
+        // Global search from reset
+        settings(&m, 5);
+        limit = m.u8Particles * m.u8SearchIter;
+        mppt_rst(&m);
+        for (k = 0; k < limit && m.u8Searching; k++)
+        {
+            measure(&m);
+            mppt_algorithm(&m);
+        }
+        dpso = m.u16Duty;
+        evals = m.u16Evals;
+        done = !m.u8Searching;
+        ppso = power_at(dpso, 0, 0);
+
+        // Local tracking only, from the same reset, for comparison
+        settings(&m, 0);
+        mppt_rst(&m);
+        for (k = 0; k < 200; k++)
+        {
+            measure(&m);
+            mppt_algorithm(&m);
+        }
+        plocal = power_at(m.u16Duty, 0, 0);
+
+        printf("%-26s %5u %8.0fW %9.3f %11.3f %8.0fW %6u %10.0fW\n",
+               curves[c].pcName, peaks, pbest, dbest / 1000.0, dpso / 1000.0,
+               ppso, evals, plocal);
+
+        if (!done || ppso < PASS_RATIO * pbest)
+        {
+            printf("  FAIL: %s\n", done ? "search ended off the global peak" : "search did not end");
+            fails++;
+        }
+    }
+
+    printf("%d of %u curves failed\n", fails, (unsigned)NCURVES);
+    return fails ? 1 : 0;
+}
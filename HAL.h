@@ -0,0 +1,87 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+
+// Thin hardware layer for the control firmware.
+// HAL_MSP430.c drives the MSP430FR5969 peripherals, HAL_LINUX.c runs the
+// same firmware as a PC program with ADC samples from stdin or a callback.
+
+#define HAL_CH_A10 0            // PV voltage sensor, A10 on P4.2
+#define HAL_CH_A7  1            // PV current sensor, A7 on P2.4
+
+#ifndef HAL_ADC_BLOCK
+#define HAL_ADC_BLOCK 32        // A10/A7 pairs per DMA block, power of two
+#endif
+#define HAL_ADC_PAIR_CYCLES 92  // SMCLK cycles per pair when free running, ~10.9k pairs/s
+
+#define HAL_ADC_FREE    0       // Block trigger: free running sequences, oversampling
+#define HAL_ADC_PWM     1       // Block trigger: TA1.2 at the middle of the on time, one
+                                // conversion per PWM period, a pair every two periods
+
+#ifndef HAL_UART_TX_SIZE
+#define HAL_UART_TX_SIZE 128    // UART transmit ring buffer, power of two
+#endif
+#ifndef HAL_UART_RX_SIZE
+#define HAL_UART_RX_SIZE 16     // UART receive ring buffer, power of two
+#endif
+#define HAL_NV_SIZE 32          // Bytes kept over resets and power cycles (FRAM)
+
+// Called from the ADC interrupt with the converted channel and result
+typedef void (*tHAL_ADC_ISR)(uint8_t channel, uint16_t value);
+
+// Called from the ADC interrupt with both results of one A10/A7 sequence
+typedef void (*tHAL_ADC_PAIR_ISR)(uint16_t voltage, uint16_t current);
+
+void hal_init(void);                           // Watchdog, LED, UART and ADC pins, TB0 cycle counter
+void hal_cpu_fast(void);                       // MCLK 8MHz, SMCLK and the peripherals stay at 1MHz
+void hal_adc_init(tHAL_ADC_ISR isr);           // 12-bit ADC12, Vref = 2.5V
+void hal_adc_start(uint8_t channel);           // Start a single conversion
+void hal_adc_pair_init(tHAL_ADC_PAIR_ISR isr); // A10 then A7 as one sequence, a few us apart
+void hal_adc_pair_start(void);                 // Start one A10/A7 sequence
+void hal_adc_block_init(uint8_t trigger);      // A10/A7 sequences, DMA into ping-pong blocks
+uint8_t hal_adc_block_get(const uint16_t **ppu16Voltage, const uint16_t **ppu16Current);  // 1 if a new block is ready
+uint16_t hal_adc_block_overrun(void);          // Blocks dropped because the previous one was not taken
+void hal_adc_timer_init(tHAL_ADC_ISR isr, uint8_t channel, uint16_t decim);   // One conversion every decim PWM periods, after hal_pwm_init
+void hal_adc_timer_pair_init(tHAL_ADC_PAIR_ISR isr, uint16_t decim);      // Same for A10/A7 sequences
+uint16_t hal_adc_isr_max(void);                // Longest ADC interrupt so far, SMCLK cycles (us)
+void hal_pwm_init(uint16_t ccr0, uint16_t duty);   // TA1.1 on P1.2, reset/set, period = ccr0 + 1
+void hal_pwm_set(uint16_t duty);
+uint16_t hal_pwm_ccr0(void);
+void hal_uart_init(void);                      // eUSCI_A0, 115200 baud at 1MHz SMCLK
+void hal_uart_putc(char c);                    // Queue for the TX interrupt, never waits, dropped when full
+uint16_t hal_uart_tx_free(void);               // Free space in the TX ring buffer
+uint16_t hal_uart_tx_overflow(void);           // Characters dropped on a full buffer since reset
+void hal_uart_flush(void);                     // Wait until everything queued has been sent
+int16_t hal_uart_getc(void);                   // Next received character, -1 if none
+void hal_nv_read(void *pvData, uint16_t u16Len);         // From the start of the NV area, at most HAL_NV_SIZE
+void hal_nv_write(const void *pvData, uint16_t u16Len);
+void hal_led_set(uint8_t on);
+void hal_led_toggle(void);
+void hal_sleep(void);                          // Low power wait for the next interrupt
+void hal_irq_enable(void);                     // Interrupts on, for a main loop that never calls hal_sleep()
+uint16_t hal_irq_save(void);                   // Mask all interrupts, returns the previous state
+void hal_irq_restore(uint16_t state);          // Undo hal_irq_save()
+
+#ifdef __MSP430__
+#include <msp430.h>
+#define HAL_DELAY_CYCLES(n) __delay_cycles(n)
+#else
+void hal_linux_delay(uint32_t cycles);
+#define HAL_DELAY_CYCLES(n) hal_linux_delay(n)
+
+// Linux backend hooks. ADC results are read from stdin (one integer per
+// conversion, the program exits at end of input) and PWM updates are stored
+// for hal_linux_pwm_duty(). By default UART output goes to stdout, nothing
+// is received and the NV area is a zeroed buffer in memory. Closed loop
+// runs against a simulated plant go through SIM_LOOP instead.
+typedef void (*tHAL_UART_SINK)(char c);
+typedef int16_t (*tHAL_UART_SOURCE)(void);
+
+void hal_linux_set_uart_sink(tHAL_UART_SINK sink);
+void hal_linux_set_uart_source(tHAL_UART_SOURCE source); // Received characters, -1 if none (default)
+uint16_t hal_linux_pwm_duty(void);
+uint64_t hal_linux_cycles(void);               // Simulated SMCLK cycles (us) spent in delays
+#endif
+
+#endif
@@ -0,0 +1,369 @@
+// Linux backend of HAL.h, runs the control firmware as a PC program.
+// Conversions complete inside hal_sleep() and delays only advance a cycle
+// counter, so the firmware runs as fast as the host allows.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "HAL.h"
+
+static tHAL_ADC_ISR adc_isr = 0;
+static tHAL_ADC_PAIR_ISR adc_pair_isr = 0;
+static tHAL_UART_SINK uart_sink = 0;
+static tHAL_UART_SOURCE uart_source = 0;
+static uint8_t nv_area[HAL_NV_SIZE];
+
+static uint8_t adc_channel = HAL_CH_A10;
+static uint8_t adc_pending = 0;           // 1: single conversion, 2: A10/A7 pair
+static uint8_t adc_block_mode = 0;           // 1 + HAL_ADC_FREE / HAL_ADC_PWM
+static uint8_t block_ready = 0;
+static uint16_t adc_block[2][HAL_ADC_BLOCK];   // A10, A7
+static uint16_t pwm_ccr0 = 0;
+static uint16_t pwm_duty = 0;
+static uint8_t led = 0;
+static uint64_t cycles = 0;               // SMCLK, 1MHz
+static uint8_t mclk_div = 1;              // MCLK / SMCLK, delays are in MCLK cycles
+
+// Timer triggered conversions, one every adc_timer_period SMCLK cycles of delay
+static uint32_t adc_timer_period = 0;
+static uint32_t adc_timer_cycles = 0;
+
+// Fill level of the MSP430 TX ring buffer, drained at 115200 baud against
+// the delay cycle counter, so overflows show up the same as on the board
+#define UART_CYCLES_PER_CHAR 87                // 10 bits at 115200 baud, 1MHz
+static uint16_t tx_queued = 0;
+static uint32_t tx_cycles = 0;
+static uint16_t tx_overflow = 0;
+
+static int32_t stdin_source(uint8_t channel)
+{
+    long value;
+
+    (void)channel;
+    if (scanf("%ld", &value) != 1)
+        return -1;
+
+    if (value < 0) value = 0;
+    if (value > 4095) value = 4095;
+    return (int32_t)value;
+}
+
+static void advance(uint32_t n);
+
+void hal_init(void)
+{
+    led = 0;
+    cycles = 0;
+    mclk_div = 1;
+}
+
+void hal_cpu_fast(void)
+{
+    mclk_div = 8;
+}
+
+void hal_adc_init(tHAL_ADC_ISR isr)
+{
+    adc_timer_period = 0;
+    adc_isr = isr;
+    adc_pair_isr = 0;
+    adc_block_mode = 0;
+    adc_pending = 0;
+}
+
+void hal_adc_pair_init(tHAL_ADC_PAIR_ISR isr)
+{
+    adc_timer_period = 0;
+    adc_isr = 0;
+    adc_pair_isr = isr;
+    adc_pending = 0;
+    adc_block_mode = 0;
+}
+
+// Both results are read in hal_sleep(), A10 first, the same stdin format as
+// alternating single conversions
+void hal_adc_pair_start(void)
+{
+    adc_pending = 2;
+}
+
+// Each hal_sleep() reads one block of HAL_ADC_BLOCK pairs (A10 first, as
+// for single pairs) and advances the clock by the block time
+void hal_adc_block_init(uint8_t trigger)
+{
+    adc_timer_period = 0;
+    adc_isr = 0;
+    adc_pair_isr = 0;
+    adc_pending = 0;
+    adc_block_mode = 1 + trigger;
+    block_ready = 0;
+}
+
+uint8_t hal_adc_block_get(const uint16_t **ppu16Voltage, const uint16_t **ppu16Current)
+{
+    if (!block_ready)
+        return 0;
+    block_ready = 0;
+
+    *ppu16Voltage = adc_block[0];
+    *ppu16Current = adc_block[1];
+    return 1;
+}
+
+uint16_t hal_adc_block_overrun(void)
+{
+    return 0;
+}
+
+// Conversions happen as hal_linux_delay() passes the trigger points, one
+// value from stdin or the source each, and call the ISR right there
+void hal_adc_timer_init(tHAL_ADC_ISR isr, uint8_t channel, uint16_t decim)
+{
+    adc_isr = isr;
+    adc_pair_isr = 0;
+    adc_channel = channel;
+    adc_pending = 0;
+    adc_block_mode = 0;
+    adc_timer_period = (uint32_t)decim * (pwm_ccr0 + 1);
+    adc_timer_cycles = 0;
+}
+
+void hal_adc_timer_pair_init(tHAL_ADC_PAIR_ISR isr, uint16_t decim)
+{
+    hal_adc_timer_init(0, HAL_CH_A10, decim);
+    adc_pair_isr = isr;
+}
+
+// Not measured, host time says nothing about the MSP430
+uint16_t hal_adc_isr_max(void)
+{
+    return 0;
+}
+
+void hal_adc_start(uint8_t channel)
+{
+    adc_channel = channel;
+    adc_pending = 1;
+}
+
+void hal_pwm_init(uint16_t ccr0, uint16_t duty)
+{
+    pwm_ccr0 = ccr0;
+    hal_pwm_set(duty);
+}
+
+void hal_pwm_set(uint16_t duty)
+{
+    pwm_duty = duty;
+}
+
+uint16_t hal_pwm_ccr0(void)
+{
+    return pwm_ccr0;
+}
+
+void hal_uart_init(void)
+{
+    tx_queued = 0;
+    tx_cycles = 0;
+    tx_overflow = 0;
+}
+
+void hal_uart_putc(char c)
+{
+    if (tx_queued >= HAL_UART_TX_SIZE - 1)
+    {
+        tx_overflow++;
+        return;
+    }
+    tx_queued++;
+
+    if (uart_sink)
+        uart_sink(c);
+    else
+        putchar(c);
+}
+
+uint16_t hal_uart_tx_free(void)
+{
+    return HAL_UART_TX_SIZE - 1 - tx_queued;
+}
+
+uint16_t hal_uart_tx_overflow(void)
+{
+    return tx_overflow;
+}
+
+void hal_uart_flush(void)
+{
+    advance((uint32_t)tx_queued * UART_CYCLES_PER_CHAR);
+    fflush(stdout);
+}
+
+int16_t hal_uart_getc(void)
+{
+    return uart_source ? uart_source() : -1;
+}
+
+void hal_nv_read(void *pvData, uint16_t u16Len)
+{
+    memcpy(pvData, nv_area, u16Len < HAL_NV_SIZE ? u16Len : HAL_NV_SIZE);
+}
+
+void hal_nv_write(const void *pvData, uint16_t u16Len)
+{
+    memcpy(nv_area, pvData, u16Len < HAL_NV_SIZE ? u16Len : HAL_NV_SIZE);
+}
+
+void hal_led_set(uint8_t on)
+{
+    led = on;
+}
+
+void hal_led_toggle(void)
+{
+    led ^= 1;
+}
+
+// Interrupts are calls from hal_sleep() here, nothing to mask
+void hal_irq_enable(void)
+{
+}
+
+uint16_t hal_irq_save(void)
+{
+    return 0;
+}
+
+void hal_irq_restore(uint16_t state)
+{
+    (void)state;
+}
+
+// The pending conversion "completes" here, the same point where the
+// MSP430 firmware is woken from LPM0 by the ADC12 interrupt
+void hal_sleep(void)
+{
+    int32_t value;
+
+    // Timer triggered conversions: wait for the next one
+    if (adc_timer_period)
+    {
+        advance(adc_timer_period - adc_timer_cycles);
+        return;
+    }
+
+    if (adc_block_mode)
+    {
+        uint16_t i;
+
+        for (i = 0; i < HAL_ADC_BLOCK; i++)
+        {
+            int32_t voltage = stdin_source(HAL_CH_A10);
+            int32_t current = voltage < 0 ? -1 : stdin_source(HAL_CH_A7);
+
+            if (current < 0) {
+                fflush(stdout);
+                exit(0);
+            }
+            adc_block[0][i] = (uint16_t)voltage;
+            adc_block[1][i] = (uint16_t)current;
+        }
+
+        block_ready = 1;
+        if (adc_block_mode == 1 + HAL_ADC_PWM)
+            advance((uint32_t)HAL_ADC_BLOCK * 2 * (pwm_ccr0 + 1));
+        else
+            advance((uint32_t)HAL_ADC_BLOCK * HAL_ADC_PAIR_CYCLES);
+        return;
+    }
+
+    if (!adc_pending)
+        return;
+
+    if (adc_pending == 2)
+    {
+        int32_t current;
+
+        value = stdin_source(HAL_CH_A10);
+        current = value < 0 ? -1 : stdin_source(HAL_CH_A7);
+        adc_pending = 0;
+        if (current < 0) {
+            fflush(stdout);
+            exit(0);
+        }
+
+        if (adc_pair_isr)
+            adc_pair_isr((uint16_t)value, (uint16_t)current);
+        return;
+    }
+    adc_pending = 0;
+
+    value = stdin_source(adc_channel);
+    if (value < 0) {
+        fflush(stdout);
+        exit(0);
+    }
+
+    if (adc_isr)
+        adc_isr(adc_channel, (uint16_t)value);
+}
+
+static void advance(uint32_t n)
+{
+    cycles += n;
+
+    if (adc_timer_period)
+        adc_timer_cycles += n;
+    while (adc_timer_period && adc_timer_cycles >= adc_timer_period)
+    {
+        uint8_t channel = adc_pair_isr ? HAL_CH_A10 : adc_channel;
+        int32_t value = stdin_source(channel);
+        int32_t current = value < 0 || !adc_pair_isr ? value : stdin_source(HAL_CH_A7);
+
+        if (current < 0) {
+            fflush(stdout);
+            exit(0);
+        }
+        adc_timer_cycles -= adc_timer_period;
+        if (adc_pair_isr)
+            adc_pair_isr((uint16_t)value, (uint16_t)current);
+        else if (adc_isr)
+            adc_isr(adc_channel, (uint16_t)value);
+    }
+
+    tx_cycles += n;
+    while (tx_queued && tx_cycles >= UART_CYCLES_PER_CHAR)
+    {
+        tx_cycles -= UART_CYCLES_PER_CHAR;
+        tx_queued--;
+    }
+    if (!tx_queued)
+        tx_cycles = 0;
+}
+
+void hal_linux_delay(uint32_t n)
+{
+    advance(n / mclk_div);
+}
+
+void hal_linux_set_uart_sink(tHAL_UART_SINK sink)
+{
+    uart_sink = sink;
+}
+
+void hal_linux_set_uart_source(tHAL_UART_SOURCE source)
+{
+    uart_source = source;
+}
+
+uint16_t hal_linux_pwm_duty(void)
+{
+    return pwm_duty;
+}
+
+uint64_t hal_linux_cycles(void)
+{
+    return cycles;
+}
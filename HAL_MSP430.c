@@ -0,0 +1,556 @@
+#include <msp430.h>
+#include <stdint.h>
+#include "HAL.h"
+
+static tHAL_ADC_ISR adc_isr = 0;
+static tHAL_ADC_PAIR_ISR adc_pair_isr = 0;
+static uint8_t pwm_trigger = 0;
+static uint8_t timer_pair = 0;                // Pair sequences from TA0.1, rearmed in the ISR
+
+#define ADC_SAMPLE_CYCLES 32                  // ADC12SHT0_3 on SMCLK, centred on the trigger point
+static uint8_t adc_channel = HAL_CH_A10;
+
+// DMA block acquisition, the DMA fills one half while the other is processed
+static uint16_t adc_block[2][2][HAL_ADC_BLOCK];  // [half][A10, A7][pair]
+static volatile uint8_t block_ready = 0;        // Half to hand out + 1, 0 = none
+static volatile uint16_t block_overrun = 0;
+
+static volatile uint16_t adc_isr_max = 0;     // TB0 counts, SMCLK
+
+// UART TX ring buffer: main code only moves the head, the TX interrupt only
+// moves the tail, so no locking is needed with 16-bit indices
+static char tx_buf[HAL_UART_TX_SIZE];
+static volatile uint16_t tx_head = 0;
+static volatile uint16_t tx_tail = 0;
+static volatile uint16_t tx_overflow = 0;
+
+// UART RX ring buffer, the other way round, characters are dropped when full
+static char rx_buf[HAL_UART_RX_SIZE];
+static volatile uint16_t rx_head = 0;
+static volatile uint16_t rx_tail = 0;
+
+// NV area in FRAM, kept over resets and power cycles. The MPU is left
+// disabled, so plain writes go through without FRAM wait states up to 8MHz.
+#if defined(__TI_COMPILER_VERSION__)
+#pragma PERSISTENT(nv_area)
+static uint8_t nv_area[HAL_NV_SIZE] = { 0 };
+#elif defined(__IAR_SYSTEMS_ICC__)
+static __persistent uint8_t nv_area[HAL_NV_SIZE] = { 0 };
+#elif defined(__GNUC__)
+static uint8_t __attribute__ ((persistent)) nv_area[HAL_NV_SIZE] = { 0 };
+#else
+#error Compiler not supported!
+#endif
+
+void hal_init(void)
+{
+    WDTCTL = WDTPW | WDTHOLD;
+
+    // GPIO Setup for LED
+    P1OUT &= ~BIT0;
+    P1DIR |= BIT0;
+
+    // Configure UART pins
+    P2SEL1 |= BIT0 | BIT1;                    // P2.0 = RXD, P2.1 = TXD
+    P2SEL0 &= ~(BIT0 | BIT1);
+
+    // Configure ADC pins
+    P4SEL1 |= BIT2;                           // A10 on P4.2
+    P4SEL0 |= BIT2;
+
+    P2SEL1 |= BIT4;                           // A7 on P2.4
+    P2SEL0 |= BIT4;
+
+    PM5CTL0 &= ~LOCKLPM5;
+
+    // Free running SMCLK count, timestamps the ADC interrupt
+    TB0CTL = TBSSEL__SMCLK | MC__CONTINUOUS | TBCLR;
+}
+
+// DCO stays at its 8MHz reset setting, only the MCLK divider changes, so
+// the UART, PWM and TB0 keep their 1MHz SMCLK. No FRAM wait states are
+// needed up to 8MHz.
+void hal_cpu_fast(void)
+{
+    CSCTL0_H = CSKEY_H;                       // Unlock CS registers
+    CSCTL1 = DCOFSEL_6;                       // DCO 8MHz
+    CSCTL3 = DIVA__1 | DIVS__8 | DIVM__1;     // MCLK 8MHz, SMCLK 1MHz
+    CSCTL0_H = 0;
+}
+
+void hal_adc_init(tHAL_ADC_ISR isr)
+{
+    timer_pair = 0;
+    adc_isr = isr;
+    adc_pair_isr = 0;
+
+    while(REFCTL0 & REFGENBUSY);
+    REFCTL0 |= REFVSEL_2 | REFON;             // Internal ref = 2.5V ON
+    while(!(REFCTL0 & REFGENRDY));
+
+    // Configure ADC12
+    ADC12CTL0 = ADC12SHT0_2 | ADC12ON;
+    ADC12CTL1 = ADC12SHP;
+    ADC12CTL2 |= ADC12RES_2;                  // 12-bit resolution
+    ADC12IER0 |= ADC12IE0;
+    ADC12MCTL0 = ADC12INCH_10 | ADC12VRSEL_1; // A10, Vref=2.5V
+}
+
+// Sequence-of-channels mode: one ADC12SC converts MEM0 = A10 and then
+// MEM1 = A7 (end of sequence) back to back, ADC12MSC skips the wait for a
+// new trigger between them. Only MEM1 interrupts, with both results ready.
+void hal_adc_pair_init(tHAL_ADC_PAIR_ISR isr)
+{
+    timer_pair = 0;
+    adc_isr = 0;
+    adc_pair_isr = isr;
+
+    while(REFCTL0 & REFGENBUSY);
+    REFCTL0 |= REFVSEL_2 | REFON;             // Internal ref = 2.5V ON
+    while(!(REFCTL0 & REFGENRDY));
+
+    ADC12CTL0 = ADC12SHT0_2 | ADC12MSC | ADC12ON;
+    ADC12CTL1 = ADC12SHP | ADC12CONSEQ_1;     // Single sequence from MEM0
+    ADC12CTL2 |= ADC12RES_2;                  // 12-bit resolution
+    ADC12MCTL0 = ADC12INCH_10 | ADC12VRSEL_1; // A10, Vref=2.5V
+    ADC12MCTL1 = ADC12INCH_7 | ADC12VRSEL_1 | ADC12EOS;   // A7, last of the sequence
+    ADC12IER0 = ADC12IE1;
+    ADC12CTL0 |= ADC12ENC;
+}
+
+void hal_adc_pair_start(void)
+{
+    ADC12CTL0 |= ADC12SC;
+}
+
+// Repeated A10/A7 sequences clocked from SMCLK, 32 sample + 14 conversion
+// cycles per channel. In sequence modes the DMA is triggered once per
+// sequence, DMA0 moves MEM0 and DMA1 moves MEM1, so the halves hold separate
+// voltage and current arrays. Both run in repeated single transfer mode over
+// HAL_ADC_BLOCK pairs.
+//
+// HAL_ADC_FREE: ADC12MSC runs the sequences back to back, ~21.7 kSPS.
+// HAL_ADC_PWM: every rising edge of the TA1.2 output starts one conversion.
+// TA1.2 is set at TA1CCR2 and reset at TA1CCR0, and hal_pwm_set() keeps
+// CCR2 so that the sample window is centred on the middle of the on time.
+// There the inductor current equals its average over the period and the
+// switching ripple cancels, and the rate is fixed by the PWM.
+void hal_adc_block_init(uint8_t trigger)
+{
+    timer_pair = 0;
+    adc_isr = 0;
+    adc_pair_isr = 0;
+    block_ready = 0;
+    block_overrun = 0;
+    pwm_trigger = trigger == HAL_ADC_PWM;
+
+    while(REFCTL0 & REFGENBUSY);
+    REFCTL0 |= REFVSEL_2 | REFON;             // Internal ref = 2.5V ON
+    while(!(REFCTL0 & REFGENRDY));
+
+    if (pwm_trigger)
+    {
+        ADC12CTL0 = ADC12SHT0_3 | ADC12ON;    // One conversion per trigger edge
+        ADC12CTL1 = ADC12SHP | ADC12SHS_4 | ADC12SSEL_3 | ADC12CONSEQ_3;   // TA1.2, SMCLK, repeated sequence
+        TA1CCTL2 = OUTMOD_3;                  // Set at CCR2, reset at CCR0
+        hal_pwm_set(TA1CCR1);
+    }
+    else
+    {
+        ADC12CTL0 = ADC12SHT0_3 | ADC12MSC | ADC12ON;
+        ADC12CTL1 = ADC12SHP | ADC12SSEL_3 | ADC12CONSEQ_3;   // SMCLK, repeated sequence
+    }
+    ADC12CTL2 |= ADC12RES_2;                  // 12-bit resolution
+    ADC12MCTL0 = ADC12INCH_10 | ADC12VRSEL_1; // A10, Vref=2.5V
+    ADC12MCTL1 = ADC12INCH_7 | ADC12VRSEL_1 | ADC12EOS;   // A7, last of the sequence
+    ADC12IER0 = 0;                            // Results are taken by the DMA
+
+    DMACTL0 = DMA0TSEL__ADC12IFG | DMA1TSEL__ADC12IFG;
+
+    __data16_write_addr((unsigned short)&DMA0SA, (unsigned long)&ADC12MEM0);
+    __data16_write_addr((unsigned short)&DMA0DA, (unsigned long)&adc_block[0][0][0]);
+    DMA0SZ = HAL_ADC_BLOCK;
+    DMA0CTL = DMADT_4 | DMASRCINCR_0 | DMADSTINCR_3 | DMAEN;
+
+    __data16_write_addr((unsigned short)&DMA1SA, (unsigned long)&ADC12MEM1);
+    __data16_write_addr((unsigned short)&DMA1DA, (unsigned long)&adc_block[0][1][0]);
+    DMA1SZ = HAL_ADC_BLOCK;
+    DMA1CTL = DMADT_4 | DMASRCINCR_0 | DMADSTINCR_3 | DMAIE | DMAEN;
+
+    // The addresses above are latched by DMAEN. The registers now hold the
+    // next reload, so the second block goes to the other half.
+    __data16_write_addr((unsigned short)&DMA0DA, (unsigned long)&adc_block[1][0][0]);
+    __data16_write_addr((unsigned short)&DMA1DA, (unsigned long)&adc_block[1][1][0]);
+
+    if (pwm_trigger)
+        ADC12CTL0 |= ADC12ENC;
+    else
+        ADC12CTL0 |= ADC12ENC | ADC12SC;
+}
+
+// Hands out the last completed half. It has to be processed before the DMA
+// comes back to it, one block time later.
+uint8_t hal_adc_block_get(const uint16_t **ppu16Voltage, const uint16_t **ppu16Current)
+{
+    uint8_t ready = block_ready;
+
+    if (!ready)
+        return 0;
+    block_ready = 0;
+
+    *ppu16Voltage = adc_block[ready - 1][0];
+    *ppu16Current = adc_block[ready - 1][1];
+    return 1;
+}
+
+uint16_t hal_adc_block_overrun(void)
+{
+    return block_overrun;
+}
+
+// Control rate conversions: TA0.1 triggers one A10 or A7 conversion every
+// decim PWM periods and the result goes to the callback, so the control law
+// runs in the ADC interrupt at a rate derived from the PWM. TA0 counts
+// decim PWM periods from the same SMCLK and is cleared together with TA1,
+// so the trigger stays at a fixed point of the PWM period, its middle.
+static void timer_trigger_start(uint16_t decim)
+{
+    uint16_t period = TA1CCR0 + 1;
+
+    TA0CCR0 = decim * period - 1;
+    TA0CCR1 = period >> 1;                    // Middle of the first PWM period
+    TA0CCTL1 = OUTMOD_3;                      // Set at CCR1, reset at CCR0
+    TA0CTL = TASSEL__SMCLK | MC__UP;
+    TA0CTL |= TACLR;                          // Back to back, both restart from 0
+    TA1CTL |= TACLR;
+}
+
+void hal_adc_timer_init(tHAL_ADC_ISR isr, uint8_t channel, uint16_t decim)
+{
+    adc_isr = isr;
+    adc_pair_isr = 0;
+    adc_channel = channel;
+    adc_isr_max = 0;
+    timer_pair = 0;
+
+    while(REFCTL0 & REFGENBUSY);
+    REFCTL0 |= REFVSEL_2 | REFON;             // Internal ref = 2.5V ON
+    while(!(REFCTL0 & REFGENRDY));
+
+    ADC12CTL0 = ADC12SHT0_2 | ADC12ON;
+    ADC12CTL1 = ADC12SHP | ADC12SHS_1 | ADC12CONSEQ_2;    // TA0.1, repeated single channel
+    ADC12CTL2 |= ADC12RES_2;                  // 12-bit resolution
+    if (channel == HAL_CH_A10)
+        ADC12MCTL0 = ADC12INCH_10 | ADC12VRSEL_1;
+    else
+        ADC12MCTL0 = ADC12INCH_7 | ADC12VRSEL_1;
+    ADC12IER0 = ADC12IE0;
+
+    timer_trigger_start(decim);
+    ADC12CTL0 |= ADC12ENC;
+}
+
+// Same trigger for an A10/A7 sequence, ADC12MSC converts A7 right after
+// A10. A single sequence with an external trigger has to be rearmed by
+// toggling ADC12ENC, the ISR does that before calling back.
+void hal_adc_timer_pair_init(tHAL_ADC_PAIR_ISR isr, uint16_t decim)
+{
+    adc_isr = 0;
+    adc_pair_isr = isr;
+    adc_isr_max = 0;
+    timer_pair = 1;
+
+    while(REFCTL0 & REFGENBUSY);
+    REFCTL0 |= REFVSEL_2 | REFON;             // Internal ref = 2.5V ON
+    while(!(REFCTL0 & REFGENRDY));
+
+    ADC12CTL0 = ADC12SHT0_2 | ADC12MSC | ADC12ON;
+    ADC12CTL1 = ADC12SHP | ADC12SHS_1 | ADC12CONSEQ_1;    // TA0.1, single sequence
+    ADC12CTL2 |= ADC12RES_2;                  // 12-bit resolution
+    ADC12MCTL0 = ADC12INCH_10 | ADC12VRSEL_1; // A10, Vref=2.5V
+    ADC12MCTL1 = ADC12INCH_7 | ADC12VRSEL_1 | ADC12EOS;   // A7, last of the sequence
+    ADC12IER0 = ADC12IE1;
+
+    timer_trigger_start(decim);
+    ADC12CTL0 |= ADC12ENC;
+}
+
+uint16_t hal_adc_isr_max(void)
+{
+    return adc_isr_max;
+}
+
+void hal_adc_start(uint8_t channel)
+{
+    ADC12CTL0 &= ~ADC12ENC;
+
+    if (channel == HAL_CH_A10)
+        ADC12MCTL0 = ADC12INCH_10 | ADC12VRSEL_1;
+    else
+        ADC12MCTL0 = ADC12INCH_7 | ADC12VRSEL_1;
+
+    adc_channel = channel;
+    if (pwm_trigger)
+        ADC12CTL0 |= ADC12ENC;
+    else
+        ADC12CTL0 |= ADC12ENC | ADC12SC;
+}
+
+void hal_pwm_init(uint16_t ccr0, uint16_t duty)
+{
+    P1DIR |= BIT2;
+    P1SEL0 |= BIT2;
+    P1SEL1 &= ~BIT2;
+
+    TA1CCR0 = ccr0;                           // PWM period
+    TA1CCTL1 = OUTMOD_7;                      // Reset/Set mode
+    TA1CCR1 = duty;
+    TA1CTL = TASSEL__SMCLK | MC__UP | TACLR;
+}
+
+void hal_pwm_set(uint16_t duty)
+{
+    TA1CCR1 = duty;
+
+    // ADC trigger, sample window centred on duty / 2
+    if (pwm_trigger)
+        TA1CCR2 = duty > ADC_SAMPLE_CYCLES ? (duty - ADC_SAMPLE_CYCLES) >> 1 : 0;
+}
+
+uint16_t hal_pwm_ccr0(void)
+{
+    return TA1CCR0;
+}
+
+void hal_uart_init(void)
+{
+    UCA0CTLW0 = UCSWRST;
+    UCA0CTLW0 |= UCSSEL__SMCLK;
+
+    UCA0BR0 = 8;                              // 1MHz / 115200 = ~8.68
+    UCA0BR1 = 0;
+    UCA0MCTLW = 0xD600;
+
+    UCA0CTLW0 &= ~UCSWRST;
+    UCA0IE |= UCRXIE;
+}
+
+void hal_uart_putc(char c)
+{
+    uint16_t next = (tx_head + 1) & (HAL_UART_TX_SIZE - 1);
+
+    if (next == tx_tail)
+    {
+        tx_overflow++;
+        return;
+    }
+
+    tx_buf[tx_head] = c;
+    tx_head = next;
+    UCA0IE |= UCTXIE;                         // TXIFG is set while idle, so this starts sending
+}
+
+uint16_t hal_uart_tx_free(void)
+{
+    return (tx_tail - tx_head - 1) & (HAL_UART_TX_SIZE - 1);
+}
+
+uint16_t hal_uart_tx_overflow(void)
+{
+    return tx_overflow;
+}
+
+void hal_uart_flush(void)
+{
+    while (tx_head != tx_tail);
+    while (UCA0STATW & UCBUSY);
+}
+
+int16_t hal_uart_getc(void)
+{
+    char c;
+
+    if (rx_tail == rx_head)
+        return -1;
+
+    c = rx_buf[rx_tail];
+    rx_tail = (rx_tail + 1) & (HAL_UART_RX_SIZE - 1);
+    return (uint8_t)c;
+}
+
+void hal_nv_read(void *pvData, uint16_t u16Len)
+{
+    uint16_t i;
+
+    for (i = 0; i < u16Len && i < HAL_NV_SIZE; i++)
+        ((uint8_t *)pvData)[i] = nv_area[i];
+}
+
+void hal_nv_write(const void *pvData, uint16_t u16Len)
+{
+    uint16_t i;
+
+    for (i = 0; i < u16Len && i < HAL_NV_SIZE; i++)
+        nv_area[i] = ((const uint8_t *)pvData)[i];
+}
+
+void hal_led_set(uint8_t on)
+{
+    if (on)
+        P1OUT |= BIT0;
+    else
+        P1OUT &= ~BIT0;
+}
+
+void hal_led_toggle(void)
+{
+    P1OUT ^= BIT0;
+}
+
+void hal_sleep(void)
+{
+    __bis_SR_register(LPM0_bits + GIE);
+    __no_operation();
+}
+
+void hal_irq_enable(void)
+{
+    __no_operation();
+    __enable_interrupt();
+    __no_operation();
+}
+
+// Out of line on purpose: the compiler cannot move the shared accesses
+// between hal_irq_save() and hal_irq_restore() across the calls
+uint16_t hal_irq_save(void)
+{
+    uint16_t state = __get_SR_register() & GIE;
+
+    __disable_interrupt();
+    __no_operation();
+    return state;
+}
+
+void hal_irq_restore(uint16_t state)
+{
+    if (state)
+        hal_irq_enable();
+}
+
+#if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
+#pragma vector = USCI_A0_VECTOR
+__interrupt void USCI_A0_ISR(void)
+#elif defined(__GNUC__)
+void __attribute__ ((interrupt(USCI_A0_VECTOR))) USCI_A0_ISR (void)
+#else
+#error Compiler not supported!
+#endif
+{
+    switch (__even_in_range(UCA0IV, USCI_UART_UCTXCPTIFG))
+    {
+        case USCI_UART_UCRXIFG:
+        {
+            uint16_t next = (rx_head + 1) & (HAL_UART_RX_SIZE - 1);
+            char c = UCA0RXBUF;               // Reading clears RXIFG
+
+            if (next != rx_tail)
+            {
+                rx_buf[rx_head] = c;
+                rx_head = next;
+            }
+            __bic_SR_register_on_exit(LPM0_bits);
+            break;
+        }
+        case USCI_UART_UCTXIFG:
+            if (tx_tail != tx_head)
+            {
+                UCA0TXBUF = tx_buf[tx_tail];
+                tx_tail = (tx_tail + 1) & (HAL_UART_TX_SIZE - 1);
+            }
+            else
+            {
+                UCA0IE &= ~UCTXIE;            // Empty, restarted by the next hal_uart_putc
+            }
+            break;
+        default: break;
+    }
+}
+
+// One interrupt per block: DMA1 finishes after DMA0 on the same trigger
+#if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
+#pragma vector = DMA_VECTOR
+__interrupt void DMA_ISR(void)
+#elif defined(__GNUC__)
+void __attribute__ ((interrupt(DMA_VECTOR))) DMA_ISR (void)
+#else
+#error Compiler not supported!
+#endif
+{
+    static uint8_t done = 0;                  // Half the DMA just completed
+
+    switch (__even_in_range(DMAIV, DMAIV_DMA1IFG))
+    {
+        case DMAIV_DMA1IFG:
+            if (block_ready)
+                block_overrun++;
+            block_ready = done + 1;
+
+            // The reload has already switched to the other half, the one
+            // after it is this half again
+            __data16_write_addr((unsigned short)&DMA0DA, (unsigned long)&adc_block[done][0][0]);
+            __data16_write_addr((unsigned short)&DMA1DA, (unsigned long)&adc_block[done][1][0]);
+            done ^= 1;
+
+            __bic_SR_register_on_exit(LPM0_bits);
+            break;
+        default: break;
+    }
+}
+
+#if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
+#pragma vector = ADC12_VECTOR
+__interrupt void ADC12_ISR(void)
+#elif defined(__GNUC__)
+void __attribute__ ((interrupt(ADC12_VECTOR))) ADC12_ISR (void)
+#else
+#error Compiler not supported!
+#endif
+{
+    uint16_t start = TB0R;
+    uint16_t time;
+
+    switch (__even_in_range(ADC12IV, ADC12IV_ADC12RDYIFG))
+    {
+        case ADC12IV_ADC12IFG0:
+        {
+            uint16_t value = ADC12MEM0;
+
+            if (adc_isr)
+                adc_isr(adc_channel, value);
+
+            __bic_SR_register_on_exit(LPM0_bits);
+            break;
+        }
+        case ADC12IV_ADC12IFG1:
+        {
+            uint16_t voltage = ADC12MEM0;
+            uint16_t current = ADC12MEM1;             // Reading MEM1 clears the flag
+
+            if (timer_pair)
+            {
+                ADC12CTL0 &= ~ADC12ENC;               // Rearm for the next TA0.1 edge
+                ADC12CTL0 |= ADC12ENC;
+            }
+            if (adc_pair_isr)
+                adc_pair_isr(voltage, current);
+
+            __bic_SR_register_on_exit(LPM0_bits);
+            break;
+        }
+        default: break;
+    }
+
+    time = TB0R - start;
+    if (time > adc_isr_max)
+        adc_isr_max = time;
+}
@@ -0,0 +1,76 @@
+#include "MPC.h"
+
+// Finite control set MPC
+
+static int32_t mpc_abs(int32_t x)
+{
+    return x < 0 ? -x : x;
+}
+
+void tMPC_calc(tMPC* ptMPC)
+{
+    int32_t p = ptMPC->u16Period;
+    int32_t vin = ptMPC->i32VinMv * p;
+    int32_t il = ptMPC->i32IlMa;
+    int32_t e = ptMPC->i32VoutMv - ptMPC->i32VMv;
+    int32_t v, io, iref;
+    int32_t best = INT32_MAX, best_v = 0;
+    uint16_t prev = ptMPC->u16Count;
+    uint16_t c, lo, hi;
+
+    // Observer, a higher voltage than predicted means less load current
+    v = ptMPC->i32VMv + ((ptMPC->qGv * e + 128) >> 8);
+    ptMPC->i32IoMa -= (ptMPC->qGo * e + 32768) >> 16;
+    if (il < 0) il = 0;             // The diode blocks
+    io = ptMPC->i32IoMa * p;
+
+    // The only division, when Vin changes
+    if (ptMPC->i32VinMv != ptMPC->i32VinLastMv && ptMPC->i32VinMv > 0)
+    {
+        ptMPC->qIref = (ptMPC->i32VrefMv << 12) / ptMPC->i32VinMv;
+        ptMPC->i32VinLastMv = ptMPC->i32VinMv;
+    }
+    iref = (ptMPC->i32IoMa * ptMPC->qIref + 2048) >> 12;
+
+    lo = prev > ptMPC->u8Span ? prev - ptMPC->u8Span : 0;
+    hi = prev + ptMPC->u8Span;
+    if (hi > ptMPC->u16MaxCount) hi = ptMPC->u16MaxCount;
+
+    for (c = lo; c <= hi; c++)
+    {
+        int32_t dp = p - c;         // P * (1 - D)
+        int32_t i1, v1, i2, v2, cost;
+
+        // Two steps with the same count
+        i1 = il + ((ptMPC->qKl * (vin - dp * v) + 32768) >> 16);
+        if (i1 < 0) i1 = 0;
+        v1 = v + ((ptMPC->qKc * (dp * i1 - io) + 128) >> 8);
+        i2 = i1 + ((ptMPC->qKl * (vin - dp * v1) + 32768) >> 16);
+        if (i2 < 0) i2 = 0;
+        v2 = v1 + ((ptMPC->qKc * (dp * i2 - io) + 128) >> 8);
+
+        cost = mpc_abs(ptMPC->i32VrefMv - v2) +
+               ((ptMPC->qWi * mpc_abs(i2 - iref) + 128) >> 8) +
+               mpc_abs((int32_t)c - prev) * ptMPC->i32WduMv;
+
+        if (cost < best)
+        {
+            best = cost;
+            best_v = v1;
+            ptMPC->u16Count = c;
+        }
+    }
+
+    // Voltage at the next measurement with the chosen count
+    ptMPC->i32VMv = best_v;
+}
+
+// MPC reset, the model starts from the last measured voltage
+void tMPC_rst(tMPC* ptMPC)
+{
+    ptMPC->i32VMv = ptMPC->i32VoutMv;
+    ptMPC->i32IoMa = 0;
+    ptMPC->i32VinLastMv = 0;
+    ptMPC->qIref = 0;
+    ptMPC->u16Count = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef MPC_H
+#define MPC_H
+
+#include <stdint.h>
+
+// Finite control set model predictive control of the boost output voltage,
+// an alternative to tPIQ_calc in the control ISR. The candidates are the
+// PWM compare counts themselves (CCR1 = 0 .. u16MaxCount), limited to
+// u16Count +- u8Span around the last choice. Each one is run through two
+// steps of the averaged boost model
+//
+//   i' = i + Ts/L    * (Vin - (1-D) v)
+//   v' = v + Ts/Cout * ((1-D) i' - io)
+//
+// and the one with the lowest cost |Vref - v2| + Wi |i2 - iref| + Wdu |dc|
+// is applied. iref = io Vref / Vin is the inductor current that carries
+// the load at Vref; a voltage-only cost with this short horizon does not
+// work, a lower duty first raises v through (1-D) i. Vout and the
+// inductor current are measured, the load current io comes from an
+// observer on the voltage prediction error and also takes out model and
+// Vin errors.
+//
+// 32-bit integer only, no division per step: mV, mA, (1-D) = (P - count) / P,
+// constants in Q8, Q12 or Q16 so every product stays within 32 bits.
+
+#define MPC_Q16(f) ((int32_t)((f) * 65536.0f + ((f) >= 0 ? 0.5f : -0.5f)))
+#define MPC_Q8(f)  ((int32_t)((f) * 256.0f + ((f) >= 0 ? 0.5f : -0.5f)))
+
+// Model constants from the component values, P = CCR0 + 1
+#define MPC_KL(ts, l, p) MPC_Q16((ts) / ((l) * (p)))   // mA per mV count
+#define MPC_KC(ts, c, p) MPC_Q8((ts) / ((c) * (p)))    // mV per mA count
+
+typedef struct {
+    int32_t i32VrefMv;      // Output voltage reference (mV)
+    int32_t i32VinMv;       // Input voltage (mV), nominal or measured
+    int32_t i32VoutMv;      // Measured output voltage (mV)
+    int32_t i32IlMa;        // Measured inductor current (mA)
+
+    int32_t qKl;            // Ts / (L * P), MPC_KL() (Q16)
+    int32_t qKc;            // Ts / (Cout * P), MPC_KC() (Q8)
+    int32_t qGv;            // Share of the voltage prediction error taken as measured (Q8), filters the ADC noise
+    int32_t qGo;            // Load current correction per mV of prediction error (mA, Q16)
+    int32_t qWi;            // Cost of 1mA of inductor current error as a voltage error (mV, Q8)
+    int32_t i32WduMv;       // Cost of a one count change, as a voltage error (mV)
+    uint16_t u16Period;     // P, PWM counts per period (CCR0 + 1)
+    uint16_t u16MaxCount;   // Duty clamp (counts)
+    uint8_t u8Span;         // Candidates around the last count
+
+    int32_t i32VMv;         // Predicted output voltage (mV)
+    int32_t i32IoMa;        // Estimated load current (mA)
+    int32_t i32VinLastMv;   // Vin of qIref, recomputed only when it changes
+    int32_t qIref;          // Vref / Vin (Q12)
+    uint16_t u16Count;      // Output: CCR1 for the next control period
+} tMPC;
+
+void tMPC_calc(tMPC* ptMPC);
+void tMPC_rst(tMPC* ptMPC);
+
+#endif
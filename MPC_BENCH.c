@@ -0,0 +1,79 @@
+// Output voltage transients of the boost under the PI of
+// CLOSE_LOOP_BOOST_PI.c (1kHz, filtered) and the finite control set MPC
+// (CONTROL_MPC, 5kHz on unfiltered Vout and inductor current), both
+// closed loop against the PV_SIM boost. The MPC has to stay within 5% of
+// the reference sooner, also with a model 30% off.
+//
+// Build: gcc -O2 -o mpc_bench MPC_BENCH.c SIM_LOOP.c PV_SIM.c MPPT_CTRL.c PI.c ADC_FILTER.c SENSOR.c AUTOTUNE.c MPC.c -lm
+// Returns nonzero if any transient fails.
+
+#include <stdio.h>
+#include "SIM_LOOP.h"
+
+typedef struct {
+    const char *pcName;
+    double dStepTime;
+    tSIM_PROFILE tLoad;
+    float fModel;               // MPC model L and Cout relative to the plant
+} tTRANSIENT;
+
+static const tTRANSIENT transients[] = {
+    { "startup 73 ohm",         0.0, { 1, { 0.0 }, { 73.0 } }, 1.0f },
+    { "load 73 -> 36 ohm",      1.0, { 2, { 1.0, 1.001 }, { 73.0, 36.0 } }, 1.0f },
+    { "load 36 -> 73 ohm",      1.0, { 2, { 1.0, 1.001 }, { 36.0, 73.0 } }, 1.0f },
+    { "73 -> 36, model +30%",   1.0, { 2, { 1.0, 1.001 }, { 73.0, 36.0 } }, 1.3f },
+    { "73 -> 36, model -30%",   1.0, { 2, { 1.0, 1.001 }, { 73.0, 36.0 } }, 0.7f },
+};
+#define NTRANSIENTS (sizeof(transients) / sizeof(transients[0]))
+
+static void run(const tTRANSIENT* ptTransient, uint8_t u8Mpc, tSIM_RESULT* ptResult)
+{
+    tSIM_CFG cfg;
+
+    sim_default_pi(&cfg);
+    cfg.dDuration = ptTransient->dStepTime + 0.5;
+    cfg.dH = 1e-5;
+    cfg.tLoad = ptTransient->tLoad;
+    cfg.dStepTime = ptTransient->dStepTime;
+
+    if (u8Mpc)
+    {
+        float ts = 0.0002f;
+
+        cfg.u8Mpc = 1;
+        cfg.dSamplePeriod = ts;
+        cfg.tMpcSet.qKl = MPC_KL(ts, (float)cfg.tBoost.dL * ptTransient->fModel, cfg.u16PwmCcr0 + 1);
+        cfg.tMpcSet.qKc = MPC_KC(ts, (float)cfg.tBoost.dCout * ptTransient->fModel, cfg.u16PwmCcr0 + 1);
+    }
+    sim_run(&cfg, ptResult, 0);
+}
+
+int main(void)
+{
+    tSIM_RESULT pi, mpc;
+    int fails = 0;
+    unsigned c;
+
+    printf("%-24s %27s %27s\n", "", "PI 1kHz", "MPC 5kHz");
+    printf("%-24s %8s %8s %9s %8s %8s %9s\n", "transient",
+           "over", "under", "in 5%", "over", "under", "in 5%");
+
+    for (c = 0; c < NTRANSIENTS; c++)
+    {
+        run(&transients[c], 0, &pi);
+        run(&transients[c], 1, &mpc);
+
+        printf("%-24s %7.2fV %7.2fV %8.4fs %7.2fV %7.2fV %8.4fs\n", transients[c].pcName,
+               pi.dOvershoot, pi.dUndershoot, pi.dSettle5,
+               mpc.dOvershoot, mpc.dUndershoot, mpc.dSettle5);
+
+        if (mpc.dSettle5 >= pi.dSettle5)
+        {
+            printf("  FAIL: MPC did not settle sooner\n");
+            fails++;
+        }
+    }
+
+    printf("%d of %u transients failed\n", fails, (unsigned)NTRANSIENTS);
+    return fails ? 1 : 0;
+}
@@ -1,250 +1,170 @@
-#include <msp430.h>
 #include <stdint.h>
+#include "HAL.h"
+#include "MPPT_CTRL.h"
+#include "TELEMETRY.h"
 
-#define FILTER_SIZE 200
 #define PWM_PERIOD 1000         // PWM period for 1kHz frequency
 #define DUTY_STEP 10            // Duty cycle step size (1%)
 #define MIN_DUTY 100            // Minimum duty cycle (10%)
 #define MAX_DUTY 500            // Maximum duty cycle (50%)
-#define MPPT_DELAY 15            // Number of cycles to wait between MPPT adjustments
-
-volatile float voltage = 0;
-volatile float Vout = 0;
-volatile float sensor2 = 0;
-volatile float current = 0;
-volatile float power = 0;
-volatile float prev_power = 0;
-volatile float prev_voltage = 0;
-
-volatile uint16_t adc_buffer1[FILTER_SIZE] = {0};
-volatile uint16_t adc_buffer2[FILTER_SIZE] = {0};
-volatile uint16_t buffer_index1 = 0;
-volatile uint16_t buffer_index2 = 0;
-volatile uint8_t buffer_full1 = 0;
-volatile uint8_t buffer_full2 = 0;
+#define MPPT_DELAY 15            // Most cycles to wait between MPPT adjustments, the settling gate timeout
+#define ADC_TRIGGER HAL_ADC_PWM // HAL_ADC_PWM: samples at the middle of the on time, HAL_ADC_FREE: oversampling
+#if ADC_TRIGGER == HAL_ADC_PWM
+#define FILTER_SIZE 4           // Moving average over DMA blocks, 256 ms
+#define BLOCKS_PER_STEP 2       // DMA blocks per MPPT step, 2 * HAL_ADC_BLOCK * 2 PWM periods
+#define LOOP_MS 128             // MPPT step period
+#define ESTIMATOR MPPT_EST_BOXCAR   // The 4 block window is short already
+#define OS_BITS 0               // Oversampling: 12-bit block averages, 4 blocks resolve little below an LSB
+#else
+#define FILTER_SIZE 200         // Moving average over DMA blocks, ~0.6 s, with MPPT_EST_KALMAN only for a global search
+#define BLOCKS_PER_STEP 34      // DMA blocks per MPPT step, 34 * HAL_ADC_BLOCK * HAL_ADC_PAIR_CYCLES
+#define LOOP_MS 100             // MPPT step period, ~100 ms at 1MHz
+#define ESTIMATOR MPPT_EST_KALMAN   // MPPT_EST_BOXCAR: FILTER_SIZE moving average, MPPT_EST_KALMAN: restarted on each duty change.
+                                // Only the restart makes it faster than the boxcar: converged it lags as long and costs more per sample
+#define OS_BITS 2               // Oversampling: 32 pair blocks decimated to 14 bits, ~120mV at the PV input, so the
+                                // estimate over many blocks resolves the small dV and dP of a step near the MPP
+#endif
+#define OS_SAMPLES HAL_ADC_BLOCK // Conversions per filter sample, one DMA block, at least 4^OS_BITS (rounded up):
+                                // 256 with OS_BITS 4 (16 bits) turns the DMA blocks counted above into 8 block samples
+#define OS_LSB2 (1UL << (2 * OS_BITS))  // 12-bit LSB^2 in filter sample LSB^2
+#define KALMAN_Q KALMAN_Q24(1e-6 * OS_LSB2)     // Kalman process noise, irradiance change per DMA block (12-bit LSB^2)
+#define KALMAN_R KALMAN_Q24(1.0 / 32 * OS_LSB2) // Kalman noise of a DMA block, ~1 LSB per conversion over HAL_ADC_BLOCK pairs (12-bit LSB^2)
+#if ESTIMATOR == MPPT_EST_KALMAN
+#define ESTIMATE_WINDOW 1       // DMA blocks behind a measurement once the duty has changed
+#else
+#define ESTIMATE_WINDOW FILTER_SIZE
+#endif
+#define VOLT_ROBUST FILTER_HAMPEL   // Spike rejection ahead of the averages: FILTER_RAW, FILTER_MEDIAN or FILTER_HAMPEL
+#define CURR_ROBUST FILTER_HAMPEL
+#define ROBUST_SIZE 3           // Median / Hampel window (DMA blocks), delays the filter by ROBUST_SIZE / 2
+#define SETTLE_TOL 5            // Settling gate: adjust once the power moves less than 0.5% per cycle, 0 = every MPPT_DELAY
+#define SETTLE_STEPS ((ESTIMATE_WINDOW + ROBUST_SIZE / 2 + BLOCKS_PER_STEP) / BLOCKS_PER_STEP)  // Steady cycles in a row, estimate window, median delay and one block
+#define FOCV_K 850              // Fast start at 85% of the PV voltage at MIN_DUTY (per mille), 0 = start at MIN_DUTY
+#define TELEMETRY_BINARY 1      // 1: COBS framed binary samples every step (TELEMETRY.h), 0: ASCII lines
+#define TELEMETRY_MAX 64        // Longest telemetry line, only queued when it fits whole
+#define MPPT_MODE MPPT_MODE_PO  // MPPT_MODE_PO, MPPT_MODE_DPPO or MPPT_MODE_INCCOND
+#define INC_TOL 20              // IncCond hold band (2% of I), and the power change (2%) that ends a hold
+#define STEP_SCALE 0            // Variable step gain (counts per A of |dP/dV|, Q8), 0 = fixed DUTY_STEP
+#define MIN_STEP 5              // Variable step limits
+#define MAX_STEP 50
 
 // MPPT variables
-volatile uint16_t duty_cycle = 100;     // Initial duty cycle (10%)
-volatile uint8_t mppt_counter = 0;
-volatile uint8_t mppt_direction = 1;    // 1 for increase, 0 for decrease
-volatile uint8_t mppt_enabled = 0;
-
-uint8_t current_channel = 0; // 0 for A10, 1 for A7
+tMPPT myMPPT = {
+    .u16DutyStep = DUTY_STEP,
+    .u16MinDuty = MIN_DUTY,
+    .u16MaxDuty = MAX_DUTY,
+    .u8Delay = MPPT_DELAY,
+    .u16SettleTol = SETTLE_TOL,
+    .u8SettleSteps = SETTLE_STEPS,
+    .u16FilterSize = FILTER_SIZE,
+    .u8VoltRobust = VOLT_ROBUST,
+    .u8CurrRobust = CURR_ROBUST,
+    .u8RobustSize = ROBUST_SIZE,
+    .u8Estimator = ESTIMATOR,
+    .u32KalmanQ = KALMAN_Q,
+    .u32KalmanR = KALMAN_R,
+    .u8OsBits = OS_BITS,
+    .u16OsSamples = OS_SAMPLES,
+    .u8Mode = MPPT_MODE,
+    .u16IncTol = INC_TOL,
+    .u16StepScale = STEP_SCALE,
+    .u16MinStep = MIN_STEP,
+    .u16MaxStep = MAX_STEP,
+    .u16FocvK = FOCV_K,
+    .u16PwmPeriod = PWM_PERIOD
+};
+
+uint32_t time_ms = 0;
+uint8_t blocks = 0;
+
+tTELEM telem;
+uint8_t telem_buf[TELEM_FRAME_MAX];
 
-void uart_init(void);
 void uart_send_string(const char *str);
 void uart_send_char(char c);
-void send_voltage_ascii(float v);
-void pwm_init(void);
-void set_duty_cycle(uint16_t duty);
-void mppt_algorithm(void);
+void send_milli_ascii(int32_t v);
 
 int main(void)
 {
-    WDTCTL = WDTPW | WDTHOLD;              
-
-    P1OUT &= ~BIT0;
-    P1DIR |= BIT0;
-
-    // Configure UART pins
-    P2SEL1 |= BIT0 | BIT1;
-    P2SEL0 &= ~(BIT0 | BIT1);
-
-    // Configure ADC pins
-    P4SEL1 |= BIT2;                           // A10 on P4.2
-    P4SEL0 |= BIT2;
-
-    P2SEL1 |= BIT4;                           // A7 on P2.4
-    P2SEL0 |= BIT4;
-
-    PM5CTL0 &= ~LOCKLPM5;
-
-    uart_init();
-    pwm_init();
+    hal_init();
+    hal_uart_init();
 
-    
-    while(REFCTL0 & REFGENBUSY);
-    REFCTL0 |= REFVSEL_2 | REFON;
-    while(!(REFCTL0 & REFGENRDY));
-
-    // Configure ADC12
-    ADC12CTL0 = ADC12SHT0_2 | ADC12ON;
-    ADC12CTL1 = ADC12SHP;
-    ADC12CTL2 |= ADC12RES_2;
-    ADC12IER0 |= ADC12IE0;
-
-
-    ADC12MCTL0 = ADC12INCH_10 | ADC12VRSEL_1;
+    mppt_rst(&myMPPT);
+    hal_pwm_init(PWM_PERIOD - 1, myMPPT.u16Duty);
+    hal_adc_block_init(ADC_TRIGGER);
 
     uart_send_string("MPPT System Initialized\r\n");
     uart_send_string("Constant Irradiance, 25°C Operation\r\n");
+#if TELEMETRY_BINARY
+    telem_init(&telem, TELEM_TYPE_PV, LOOP_MS);
+    uart_send_char(0);      // Frame delimiter, the decoder skips the banner
+#endif
 
     while(1)
     {
-        __delay_cycles(100000);
+        const uint16_t *voltage, *current;
 
-        ADC12CTL0 &= ~ADC12ENC; 
-        
-        if(current_channel == 0)
-            ADC12MCTL0 = ADC12INCH_10 | ADC12VRSEL_1;
-        else
-            ADC12MCTL0 = ADC12INCH_7 | ADC12VRSEL_1;
-        
-        ADC12CTL0 |= ADC12ENC | ADC12SC;  
+        // Woken by the DMA once per block of A10/A7 pairs
+        hal_sleep();
+        if (!hal_adc_block_get(&voltage, &current))
+            continue;
 
-        __bis_SR_register(LPM0_bits + GIE);
-        __no_operation();
+        mppt_sample_block(&myMPPT, voltage, current, HAL_ADC_BLOCK);
+        if (++blocks < BLOCKS_PER_STEP)
+            continue;
+        blocks = 0;
+        time_ms += LOOP_MS;
 
-    
-        if (buffer_full1 && buffer_full2)
+        if (mppt_ready(&myMPPT))
         {
-            // Calculate power
-            power = voltage * current;
-            
             // Run MPPT algorithm
-            mppt_algorithm();
-            
-            // Print readings every few cycles
-            if (mppt_counter == 0)
-            {
-                uart_send_string("V=");
-                send_voltage_ascii(voltage);
-                uart_send_string("V, I=");
-                send_voltage_ascii(current);
-                uart_send_string("A, P=");
-                send_voltage_ascii(power);
-                uart_send_string("W, Duty=");
-                send_voltage_ascii((float)duty_cycle / 10.0f);
-                uart_send_string("%\r\n");
-            }
-        }
-    }
-}
-
-void uart_init(void)
-{
-    UCA0CTLW0 = UCSWRST;
-    UCA0CTLW0 |= UCSSEL__SMCLK;
-
-    UCA0BR0 = 8;
-    UCA0BR1 = 0;
-    UCA0MCTLW = 0xD600;
-
-    UCA0CTLW0 &= ~UCSWRST;
-}
+            mppt_algorithm(&myMPPT);
+            hal_pwm_set(myMPPT.u16Duty);
 
-void pwm_init(void)
-{
-    P1DIR |= BIT2;
-    P1SEL0 |= BIT2;
-    P1SEL1 &= ~BIT2;
-    
-    TA1CTL = TASSEL__SMCLK | MC__UP | TACLR;
-    TA1CCR0 = PWM_PERIOD - 1;                    // Set PWM period
-    TA1CCR1 = duty_cycle;                        // Set initial duty cycle
-    TA1CCTL1 = OUTMOD_7;                         // Reset/Set mode
-}
-
-void set_duty_cycle(uint16_t duty)
-{
-    if (duty >= MIN_DUTY && duty <= MAX_DUTY)
-    {
-        duty_cycle = duty;
-        TA1CCR1 = duty_cycle;
-    }
-}
-
-void mppt_algorithm(void)
-{
-    mppt_counter++;
-    
-
-    if (mppt_counter >= MPPT_DELAY)
-    {
-        mppt_counter = 0;
-        
-        if (!mppt_enabled)
-        {
-        
-            prev_power = power;
-            prev_voltage = voltage;
-            mppt_enabled = 1;
-            return;
-        }
-        
-        // P&O Algorithm Implementation
-        float delta_power = power - prev_power;
-        float delta_voltage = voltage - prev_voltage;
-        
-        // Avoid division by zero
-        if (delta_voltage == 0)
-        {
-            // If voltage hasn't changed, continue in same direction
-            if (mppt_direction == 1)
-            {
-                set_duty_cycle(duty_cycle + DUTY_STEP);
-            }
-            else
+            // Blink while the array delivers power
+            if (myMPPT.u8Counter == 0)
             {
-                set_duty_cycle(duty_cycle - DUTY_STEP);
+                if (myMPPT.i32Power > 100)
+                    hal_led_toggle();
             }
-        }
-        else
-        {
-            // Calculate dP/dV
-            float dp_dv = delta_power / delta_voltage;
-            
-            if (dp_dv > 0)
+
+#if TELEMETRY_BINARY
+            // Every step is logged, 8 samples per frame. A frame that does
+            // not fit in the TX ring buffer is dropped whole.
+            if (telem_push(&telem, time_ms, myMPPT.i32Voltage, myMPPT.i32Current, myMPPT.u16Duty))
             {
-                // We're on the left side of MPP, increase voltage (decrease duty)
-                if (delta_voltage > 0)
-                {
-                    // Voltage increased, decrease duty cycle
-                    set_duty_cycle(duty_cycle - DUTY_STEP);
-                    mppt_direction = 0;
-                }
-                else
+                uint16_t len = telem_frame(&telem, telem_buf);
+
+                if (hal_uart_tx_free() >= len)
                 {
-                    // Voltage decreased, increase duty cycle
-                    set_duty_cycle(duty_cycle + DUTY_STEP);
-                    mppt_direction = 1;
+                    uint16_t i;
+
+                    for (i = 0; i < len; i++)
+                        uart_send_char((char)telem_buf[i]);
                 }
             }
-            else if (dp_dv < 0)
+#else
+            // Telemetry goes through the TX ring buffer and never waits
+            if (myMPPT.u8Counter == 0 && hal_uart_tx_free() >= TELEMETRY_MAX)
             {
-                // We're on the right side of MPP, decrease voltage (increase duty)
-                if (delta_voltage > 0)
-                {
-                    // Voltage increased, increase duty cycle
-                    set_duty_cycle(duty_cycle + DUTY_STEP);
-                    mppt_direction = 1;
-                }
-                else
-                {
-                    // Voltage decreased, decrease duty cycle
-                    set_duty_cycle(duty_cycle - DUTY_STEP);
-                    mppt_direction = 0;
-                }
+                uart_send_string("V=");
+                send_milli_ascii(myMPPT.i32Voltage);
+                uart_send_string("V, I=");
+                send_milli_ascii(myMPPT.i32Current);
+                uart_send_string("A, P=");
+                send_milli_ascii(myMPPT.i32Power);
+                uart_send_string("W, Duty=");
+                send_milli_ascii((int32_t)myMPPT.u16Duty * 100);
+                uart_send_string("%\r\n");
             }
-            // If dP/dV = 0, we're at MPP, don't change duty cycle
-        }
-        
-    
-        prev_power = power;
-        prev_voltage = voltage;
-        
-    
-        if (power > 0.1f)  
-        {
-            P1OUT ^= BIT0;  
+#endif
         }
     }
 }
 
 void uart_send_char(char c)
 {
-    while (!(UCA0IFG & UCTXIFG));
-    UCA0TXBUF = c;
+    hal_uart_putc(c);
 }
 
 void uart_send_string(const char *str)
@@ -253,15 +173,16 @@ void uart_send_string(const char *str)
         uart_send_char(*str++);
 }
 
-void send_voltage_ascii(float v)
+// Prints a value given in thousandths (mV, mA, mW) as whole.frac
+void send_milli_ascii(int32_t v)
 {
     if (v < 0) {
         uart_send_char('-');
         v = -v;
     }
 
-    unsigned int whole = (unsigned int)v;
-    unsigned int frac = (unsigned int)((v - whole) * 1000);
+    unsigned int whole = (unsigned int)(v / 1000);
+    unsigned int frac = (unsigned int)(v % 1000);
 
     if (whole >= 1000) {
         uart_send_char('0' + (whole / 1000));
@@ -287,79 +208,3 @@ void send_voltage_ascii(float v)
     uart_send_char('0' + ((frac / 10) % 10));
     uart_send_char('0' + (frac % 10));
 }
-
-#if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
-#pragma vector = ADC12_VECTOR
-__interrupt void ADC12_ISR(void)
-#elif defined(__GNUC__)
-void __attribute__ ((interrupt(ADC12_VECTOR))) ADC12_ISR (void)
-#else
-#error Compiler not supported!
-#endif
-{
-    switch (__even_in_range(ADC12IV, ADC12IV_ADC12RDYIFG))
-    {
-        case ADC12IV_ADC12IFG0:
-        {
-            uint16_t value = ADC12MEM0;
-
-            if (current_channel == 0) // A10 - Voltage sensor
-            {
-                adc_buffer1[buffer_index1] = value;
-                buffer_index1++;
-                if (buffer_index1 >= FILTER_SIZE) {
-                    buffer_index1 = 0;
-                    buffer_full1 = 1;
-                }
-
-                if (buffer_full1)
-                {
-                    uint32_t sum = 0;
-                    uint16_t i;
-                    for (i = 0; i < FILTER_SIZE; i++)
-                        sum += adc_buffer1[i];
-                    uint16_t avg_adc = sum / FILTER_SIZE;
-
-                    Vout = (avg_adc * 2.5f) / 4096.0f;
-                    voltage = 772.0f * (Vout - 1.286f);
-                    
-                    // Ensure voltage is not negative
-                    if (voltage < 0) voltage = 0;
-                }
-
-                current_channel = 1; // Switch to next channel (A7)
-            }
-            else if (current_channel == 1) // A7 - Current sensor
-            {
-                adc_buffer2[buffer_index2] = value;
-                buffer_index2++;
-                if (buffer_index2 >= FILTER_SIZE) {
-                    buffer_index2 = 0;
-                    buffer_full2 = 1;
-                }
-
-                if (buffer_full2)
-                {
-                    uint32_t sum = 0;
-                    uint16_t i;
-                    for (i = 0; i < FILTER_SIZE; i++)
-                        sum += adc_buffer2[i];
-                    uint16_t avg_adc = sum / FILTER_SIZE;
-
-                    sensor2 = (avg_adc * 2.5f) / 4096.0f;
-                    current = (sensor2 - 1.653f) / 0.05f;  // Convert to current in amperes
-                    
-                    // Ensure current is not negative
-                    if (current < 0) current = 0;
-                }
-
-                current_channel = 0; // Switch back to A10
-            }
-
-            __bic_SR_register_on_exit(LPM0_bits);
-            break;
-        }
-        default: break;
-    }
-}
-
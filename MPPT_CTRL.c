@@ -0,0 +1,689 @@
+#include "MPPT_CTRL.h"
+#include "SENSOR.h"
+
+// The Kalman estimates start again from the next sample. The spike filter
+// ahead of them delays by u8RobustSize / 2 samples, its delay line still
+// holds the old operating point and is emptied as well.
+static void restart_estimates(tMPPT* ptMPPT)
+{
+    tKALMAN_rst(&ptMPPT->tVoltKalman);
+    tKALMAN_rst(&ptMPPT->tCurrKalman);
+
+    if (ptMPPT->u8Estimator == MPPT_EST_KALMAN && !ptMPPT->u8Searching)
+    {
+        tFILTER_rst(&ptMPPT->tVoltFilter);
+        tFILTER_rst(&ptMPPT->tCurrFilter);
+    }
+}
+
+// Out of range requests are clamped, with the fixed step on a multiple of it
+// this is the same as ignoring them. A new duty moves the operating point,
+// the estimates restart.
+static void set_duty_cycle(tMPPT* ptMPPT, int32_t duty)
+{
+    if (duty < ptMPPT->u16MinDuty) duty = ptMPPT->u16MinDuty;
+    if (duty > ptMPPT->u16MaxDuty) duty = ptMPPT->u16MaxDuty;
+
+    if (duty != ptMPPT->u16Duty)
+        restart_estimates(ptMPPT);
+
+    ptMPPT->u16Duty = (uint16_t)duty;
+}
+
+// Step for the next perturbation. Variable step mode scales it with |dP/dV|
+// (mW/mV = A), large far from the MPP where the P-V curve is steep and small
+// next to it. One 64 bit division per MPPT decision.
+static int32_t step_size(tMPPT* ptMPPT, int32_t delta_power, int32_t delta_voltage)
+{
+    int64_t step;
+
+    if (ptMPPT->u16StepScale == 0)
+        return ptMPPT->u16DutyStep;
+
+    if (delta_voltage == 0)
+        return ptMPPT->u16MinStep;
+
+    if (delta_power < 0) delta_power = -delta_power;
+    if (delta_voltage < 0) delta_voltage = -delta_voltage;
+
+    step = ((int64_t)delta_power * ptMPPT->u16StepScale) / ((int64_t)delta_voltage << 8);
+
+    if (step < ptMPPT->u16MinStep) step = ptMPPT->u16MinStep;
+    if (step > ptMPPT->u16MaxStep) step = ptMPPT->u16MaxStep;
+    return (int32_t)step;
+}
+
+// dP-P&O falls back to plain P&O once the ramp term P - Px is below
+// 1/DPPO_RAMP_RATIO of the perturbation term
+#define DPPO_RAMP_RATIO 8
+#define DPPO_PLAIN 2
+
+// PSO weights, Q8
+#define PSO_W   102     // Inertia 0.4
+#define PSO_C1  307     // Own best 1.2
+#define PSO_C2  512     // Swarm best 2.0
+
+// The Kalman estimate takes the place of the tracking average, the boxcar
+// is left with one slot behind the spike filter. A search point needs a
+// fresh, complete window of its own and keeps the boxcar.
+static void restart_filters(tMPPT* ptMPPT, uint16_t u16Size)
+{
+    if (u16Size == 0 || u16Size > MPPT_FILTER_MAX)
+        u16Size = ptMPPT->u16FilterSize;
+    if (ptMPPT->u8Estimator == MPPT_EST_KALMAN && !ptMPPT->u8Searching)
+        u16Size = 1;
+
+    tFILTER_init(&ptMPPT->tVoltFilter, ptMPPT->au16VoltBuf, u16Size);
+    tFILTER_init(&ptMPPT->tCurrFilter, ptMPPT->au16CurrBuf, u16Size);
+    tFILTER_robust(&ptMPPT->tVoltFilter, ptMPPT->u8VoltRobust, ptMPPT->u8RobustSize);
+    tFILTER_robust(&ptMPPT->tCurrFilter, ptMPPT->u8CurrRobust, ptMPPT->u8RobustSize);
+    tKALMAN_init(&ptMPPT->tVoltKalman, ptMPPT->u32KalmanQ, ptMPPT->u32KalmanR);
+    tKALMAN_init(&ptMPPT->tCurrKalman, ptMPPT->u32KalmanQ, ptMPPT->u32KalmanR);
+    tDECIM_init(&ptMPPT->tVoltDecim, ptMPPT->u8OsBits, ptMPPT->u16OsSamples);
+    tDECIM_init(&ptMPPT->tCurrDecim, ptMPPT->u8OsBits, ptMPPT->u16OsSamples);
+}
+
+static uint8_t pso_rand(tMPPT* ptMPPT)
+{
+    uint16_t x = ptMPPT->u16Rng;
+
+    x ^= x << 7;
+    x ^= x >> 9;
+    x ^= x << 8;
+    ptMPPT->u16Rng = x;
+    return (uint8_t)x;
+}
+
+// Particles start spread evenly over the duty window, so every peak of a
+// multi-peak curve is bracketed by the first sweep
+static void search_start(tMPPT* ptMPPT)
+{
+    uint8_t n = ptMPPT->u8Particles;
+    int32_t span = (int32_t)ptMPPT->u16MaxDuty - ptMPPT->u16MinDuty;
+    uint8_t k;
+
+    if (n > MPPT_PSO_MAX) n = MPPT_PSO_MAX;
+    if (n < 2) n = 2;
+    ptMPPT->u8Particles = n;
+
+    for (k = 0; k < n; k++)
+    {
+        ptMPPT->ai16Pos[k] = (int16_t)(ptMPPT->u16MinDuty + span * k / (n - 1));
+        ptMPPT->ai16Vel[k] = 0;
+        ptMPPT->ai16Best[k] = ptMPPT->ai16Pos[k];
+        ptMPPT->ai32BestPower[k] = -1;
+    }
+    ptMPPT->i16GlobalBest = ptMPPT->ai16Pos[0];
+    ptMPPT->i32GlobalBestPower = -1;
+
+    ptMPPT->u8Searching = 1;
+    ptMPPT->u8Particle = 0;
+    ptMPPT->u8Iter = 0;
+    ptMPPT->u16Evals = 0;
+
+    set_duty_cycle(ptMPPT, ptMPPT->ai16Pos[0]);
+    restart_filters(ptMPPT, ptMPPT->u16SearchFilter);
+}
+
+// Hands the best duty found over to the local tracker
+static void search_end(tMPPT* ptMPPT)
+{
+    ptMPPT->u8Searching = 0;
+    ptMPPT->u8Counter = 0;
+    ptMPPT->u8Steady = 0;
+    ptMPPT->u8Half = 0;
+    ptMPPT->u8Plain = 0;
+    ptMPPT->u8Enabled = 0;
+
+    set_duty_cycle(ptMPPT, ptMPPT->i16GlobalBest);
+    restart_filters(ptMPPT, ptMPPT->u16FilterSize);
+}
+
+// One measurement of the swarm: the power at the present particle, taken
+// with freshly filled filters, then the duty of the next particle
+static void search_step(tMPPT* ptMPPT)
+{
+    uint8_t n = ptMPPT->u8Particles;
+    uint8_t k = ptMPPT->u8Particle;
+    int32_t span = (int32_t)ptMPPT->u16MaxDuty - ptMPPT->u16MinDuty;
+
+    ptMPPT->u16Evals++;
+
+    if (ptMPPT->i32Power > ptMPPT->ai32BestPower[k])
+    {
+        ptMPPT->ai32BestPower[k] = ptMPPT->i32Power;
+        ptMPPT->ai16Best[k] = ptMPPT->ai16Pos[k];
+    }
+    if (ptMPPT->i32Power > ptMPPT->i32GlobalBestPower)
+    {
+        ptMPPT->i32GlobalBestPower = ptMPPT->i32Power;
+        ptMPPT->i16GlobalBest = ptMPPT->ai16Pos[k];
+    }
+
+    if (++k >= n)
+    {
+        uint8_t converged = 1;
+        uint8_t j;
+
+        k = 0;
+        ptMPPT->u8Iter++;
+
+        for (j = 0; j < n; j++)
+        {
+            int32_t d = (int32_t)ptMPPT->ai16Pos[j] - ptMPPT->i16GlobalBest;
+            if (d > (int32_t)ptMPPT->u16DutyStep || d < -(int32_t)ptMPPT->u16DutyStep)
+                converged = 0;
+        }
+
+        if (converged || ptMPPT->u8Iter >= ptMPPT->u8SearchIter)
+        {
+            search_end(ptMPPT);
+            return;
+        }
+
+        for (j = 0; j < n; j++)
+        {
+            int32_t x = ptMPPT->ai16Pos[j];
+            int32_t v = (int32_t)PSO_W * ptMPPT->ai16Vel[j]
+                      + (((int32_t)PSO_C1 * pso_rand(ptMPPT)) >> 8) * (ptMPPT->ai16Best[j] - x)
+                      + (((int32_t)PSO_C2 * pso_rand(ptMPPT)) >> 8) * (ptMPPT->i16GlobalBest - x);
+
+            v /= 256;
+            if (v > span / 2) v = span / 2;
+            if (v < -span / 2) v = -span / 2;
+
+            x += v;
+            if (x < ptMPPT->u16MinDuty) x = ptMPPT->u16MinDuty;
+            if (x > ptMPPT->u16MaxDuty) x = ptMPPT->u16MaxDuty;
+
+            ptMPPT->ai16Vel[j] = (int16_t)v;
+            ptMPPT->ai16Pos[j] = (int16_t)x;
+        }
+    }
+
+    ptMPPT->u8Particle = k;
+    set_duty_cycle(ptMPPT, ptMPPT->ai16Pos[k]);
+    restart_filters(ptMPPT, ptMPPT->u16SearchFilter);
+}
+
+// Fractional open circuit voltage fast start. The PV voltage at u16MinDuty,
+// the highest the converter can hold, stands in for Voc, and the duty
+// jumps to where the PV voltage is u16FocvK of it: with Vin = Vout (1 - D)
+// and Vout taken as constant over one jump, (P - duty') = (P - duty) Vt / V.
+// With the resistive load a true Voc is never reached, switching the
+// converter off still leaves the diode conducting, so there is nothing to
+// gain from an extra open circuit interval. The tracker starts at
+// u16MinDuty anyway, the first reading costs nothing. Before any jump one
+// u16DutyStep up probes the curve: near Voc the power rises much faster
+// than the voltage falls, near the MPP it hardly moves. A probe that loses,
+// or gains less than MPPT_FAST_SLOPE times the relative voltage drop, means
+// the MPP is already near u16MinDuty and the climb takes over from there,
+// as without the fast start. A jump that loses power is undone the same way.
+static void fast_start(tMPPT* ptMPPT)
+{
+    int32_t target, error, off;
+
+    if (ptMPPT->u8FastStart == MPPT_FAST_REF)
+    {
+        ptMPPT->i32RefMv = ptMPPT->i32Voltage;
+        ptMPPT->i32PrevPower = ptMPPT->i32Power;
+        ptMPPT->u16FastDuty = ptMPPT->u16Duty;
+        set_duty_cycle(ptMPPT, ptMPPT->u16Duty + ptMPPT->u16DutyStep);
+        ptMPPT->u8FastStart = MPPT_FAST_PROBE;
+        return;
+    }
+
+    if (ptMPPT->i32Power < ptMPPT->i32PrevPower)
+    {
+        set_duty_cycle(ptMPPT, ptMPPT->u16FastDuty);
+        ptMPPT->u8FastStart = MPPT_FAST_OFF;
+        return;
+    }
+    if (ptMPPT->u8FastStart == MPPT_FAST_PROBE &&
+        (int64_t)(ptMPPT->i32Power - ptMPPT->i32PrevPower) * ptMPPT->i32RefMv <
+        (int64_t)MPPT_FAST_SLOPE * ptMPPT->i32PrevPower * (ptMPPT->i32RefMv - ptMPPT->i32Voltage))
+    {
+        // The probe gained, but too little for u16MinDuty to be near Voc
+        ptMPPT->u8FastStart = MPPT_FAST_OFF;
+        return;
+    }
+    ptMPPT->u8FastStart = MPPT_FAST_SEEK;
+
+    target = ptMPPT->i32RefMv * (int32_t)ptMPPT->u16FocvK / 1000;
+    error = ptMPPT->i32Voltage - target;
+    off = (int32_t)ptMPPT->u16PwmPeriod - ptMPPT->u16Duty;
+
+    if (error < 0) error = -error;
+    if (error * 50 <= target || ptMPPT->i32Voltage <= 0 || ++ptMPPT->u8Jumps > MPPT_FAST_JUMPS)
+    {
+        // Close enough, the tracker starts from here
+        ptMPPT->u8FastStart = MPPT_FAST_OFF;
+        return;
+    }
+
+    ptMPPT->i32PrevPower = ptMPPT->i32Power;
+    ptMPPT->u16FastDuty = ptMPPT->u16Duty;
+    set_duty_cycle(ptMPPT, (int32_t)ptMPPT->u16PwmPeriod -
+                   (int32_t)(((int64_t)off * target) / ptMPPT->i32Voltage));
+}
+
+// MPPT reset, keeps the settings and starts again from the minimum duty cycle,
+// with the fast start or with a global search when one is enabled
+void mppt_rst(tMPPT* ptMPPT)
+{
+    ptMPPT->i32Voltage = 0;
+    ptMPPT->i32Current = 0;
+    ptMPPT->i32Power = 0;
+    ptMPPT->i32PrevPower = 0;
+    ptMPPT->i32PrevVoltage = 0;
+    ptMPPT->i32PrevCurrent = 0;
+    ptMPPT->i32LastPower = 0;
+    ptMPPT->i32MidPower = 0;
+    ptMPPT->i32MidVoltage = 0;
+
+    ptMPPT->u16Duty = ptMPPT->u16MinDuty;
+    ptMPPT->u16Step = 0;
+    ptMPPT->u8Counter = 0;
+    ptMPPT->u8Steady = 0;
+    ptMPPT->u8Half = 0;
+    ptMPPT->u8Plain = 0;
+    ptMPPT->u8Direction = 1;
+    ptMPPT->u8Held = 0;
+    ptMPPT->i32HeldPower = 0;
+    ptMPPT->u8Enabled = 0;
+
+    ptMPPT->u8Searching = 0;
+    ptMPPT->u16Evals = 0;
+    ptMPPT->u16Rng = 0xACE1;
+    restart_filters(ptMPPT, ptMPPT->u16FilterSize);
+
+    ptMPPT->u8FastStart = MPPT_FAST_OFF;
+    ptMPPT->u8Jumps = 0;
+    ptMPPT->i32RefMv = 0;
+    ptMPPT->u16FastDuty = ptMPPT->u16MinDuty;
+
+    if (ptMPPT->u8Particles)
+    {
+        search_start(ptMPPT);
+    }
+    else if (ptMPPT->u16FocvK && ptMPPT->u16PwmPeriod)
+    {
+        ptMPPT->u8FastStart = MPPT_FAST_REF;
+    }
+}
+
+// ADC12 ISR work for one conversion result
+void mppt_sample(tMPPT* ptMPPT, uint8_t u8Channel, uint16_t u16Adc)
+{
+    if (u8Channel == MPPT_CH_VOLTAGE)
+    {
+        uint16_t avg_adc = tFILTER_push(&ptMPPT->tVoltFilter, u16Adc);
+
+        if (ptMPPT->u8Estimator == MPPT_EST_KALMAN && !ptMPPT->u8Searching)
+            avg_adc = tKALMAN_push(&ptMPPT->tVoltKalman, avg_adc);
+
+        if (ptMPPT->tVoltFilter.u8Full)
+        {
+            ptMPPT->i32Voltage = sensor_voltage_mv_ext(avg_adc, ptMPPT->u8OsBits);
+
+            // Ensure voltage is not negative
+            if (ptMPPT->i32Voltage < 0) ptMPPT->i32Voltage = 0;
+        }
+    }
+    else
+    {
+        uint16_t avg_adc = tFILTER_push(&ptMPPT->tCurrFilter, u16Adc);
+
+        if (ptMPPT->u8Estimator == MPPT_EST_KALMAN && !ptMPPT->u8Searching)
+            avg_adc = tKALMAN_push(&ptMPPT->tCurrKalman, avg_adc);
+
+        if (ptMPPT->tCurrFilter.u8Full)
+        {
+            ptMPPT->i32Current = sensor_current_ma_ext(avg_adc, ptMPPT->u8OsBits);
+
+            // Ensure current is not negative
+            if (ptMPPT->i32Current < 0) ptMPPT->i32Current = 0;
+        }
+    }
+}
+
+// A DMA block of A10/A7 pairs, decimated into filter samples of
+// 12 + u8OsBits bits, one per u16OsSamples conversions
+void mppt_sample_block(tMPPT* ptMPPT, const uint16_t *pu16Voltage, const uint16_t *pu16Current, uint16_t u16Count)
+{
+    if (tDECIM_push(&ptMPPT->tVoltDecim, pu16Voltage, u16Count))
+        mppt_sample(ptMPPT, MPPT_CH_VOLTAGE, ptMPPT->tVoltDecim.u16Out);
+    if (tDECIM_push(&ptMPPT->tCurrDecim, pu16Current, u16Count))
+        mppt_sample(ptMPPT, MPPT_CH_CURRENT, ptMPPT->tCurrDecim.u16Out);
+}
+
+uint8_t mppt_ready(tMPPT* ptMPPT)
+{
+    return ptMPPT->tVoltFilter.u8Full && ptMPPT->tCurrFilter.u8Full;
+}
+
+// Incremental conductance: at the MPP dI/dV = -I/V. Both sides are scaled
+// by V*dV so no division is needed, dP/dV has the sign of (I*dV + V*dI)*dV.
+static void inccond(tMPPT* ptMPPT, int32_t delta_voltage, int32_t delta_current)
+{
+    int32_t duty = ptMPPT->u16Duty;
+    int32_t step = step_size(ptMPPT, ptMPPT->i32Power - ptMPPT->i32PrevPower, delta_voltage);
+    int32_t moved = ptMPPT->i32Power - ptMPPT->i32HeldPower;
+
+    ptMPPT->u16Step = (uint16_t)step;
+
+    if (ptMPPT->u8Held)
+    {
+        // Nothing was perturbed since the last decision, dV and dI are the
+        // irradiance change alone and tell nothing about the side of the
+        // MPP. Once the power has moved by the hold band, perturb again in
+        // the last direction, turned round at a duty limit, so the next test
+        // has a step to see.
+        if (moved < 0) moved = -moved;
+        if ((int64_t)moved * 1000 > (int64_t)ptMPPT->i32Power * ptMPPT->u16IncTol)
+        {
+            if (duty <= ptMPPT->u16MinDuty)
+                ptMPPT->u8Direction = 1;
+            else if (duty >= ptMPPT->u16MaxDuty)
+                ptMPPT->u8Direction = 0;
+            set_duty_cycle(ptMPPT, ptMPPT->u8Direction ? duty + step : duty - step);
+        }
+    }
+    else if (delta_voltage == 0)
+    {
+        // Voltage unchanged, a current change means the irradiance moved
+        if (delta_current > 0)
+        {
+            set_duty_cycle(ptMPPT, duty - step);
+            ptMPPT->u8Direction = 0;
+        }
+        else if (delta_current < 0)
+        {
+            set_duty_cycle(ptMPPT, duty + step);
+            ptMPPT->u8Direction = 1;
+        }
+    }
+    else
+    {
+        int64_t slope = (int64_t)ptMPPT->i32Current * delta_voltage
+                      + (int64_t)ptMPPT->i32Voltage * delta_current;
+        int64_t band = (int64_t)ptMPPT->i32Current * ptMPPT->u16IncTol
+                     * (delta_voltage > 0 ? delta_voltage : -delta_voltage);
+
+        if (delta_voltage < 0) slope = -slope;
+
+        // Inside the band the operating point is held at the MPP
+        if (slope * 1000 > band)
+        {
+            // Left of MPP, increase voltage (decrease duty)
+            set_duty_cycle(ptMPPT, duty - step);
+            ptMPPT->u8Direction = 0;
+        }
+        else if (slope * 1000 < -band)
+        {
+            // Right of MPP, decrease voltage (increase duty)
+            set_duty_cycle(ptMPPT, duty + step);
+            ptMPPT->u8Direction = 1;
+        }
+    }
+
+    if (ptMPPT->u16Duty != duty)
+    {
+        ptMPPT->u8Held = 0;
+    }
+    else if (!ptMPPT->u8Held)
+    {
+        ptMPPT->u8Held = 1;
+        ptMPPT->i32HeldPower = ptMPPT->i32Power;
+    }
+}
+
+// P&O decision on the power and voltage change of the last perturbation
+static void po_step(tMPPT* ptMPPT, int32_t delta_power, int32_t delta_voltage)
+{
+    int32_t duty = ptMPPT->u16Duty;
+    int32_t step = step_size(ptMPPT, delta_power, delta_voltage);
+
+    ptMPPT->u16Step = (uint16_t)step;
+
+    // Avoid division by zero
+    if (delta_voltage == 0)
+    {
+        // If voltage hasn't changed, continue in same direction. At a
+        // duty limit that is no perturbation at all, and a quiet
+        // estimate never shows a voltage change to get out: turn round.
+        if (duty <= ptMPPT->u16MinDuty)
+            ptMPPT->u8Direction = 1;
+        else if (duty >= ptMPPT->u16MaxDuty)
+            ptMPPT->u8Direction = 0;
+
+        if (ptMPPT->u8Direction == 1)
+        {
+            set_duty_cycle(ptMPPT, duty + step);
+        }
+        else
+        {
+            set_duty_cycle(ptMPPT, duty - step);
+        }
+    }
+    else
+    {
+        // Sign of dP/dV, taken from the signs of dP and dV
+        int8_t dp_dv = 0;
+        if (delta_power != 0)
+            dp_dv = ((delta_power > 0) == (delta_voltage > 0)) ? 1 : -1;
+
+        if (dp_dv > 0)
+        {
+            // We're on the left side of MPP, increase voltage (decrease duty)
+            set_duty_cycle(ptMPPT, duty - step);
+            ptMPPT->u8Direction = 0;
+        }
+        else if (dp_dv < 0)
+        {
+            // We're on the right side of MPP, decrease voltage (increase duty)
+            set_duty_cycle(ptMPPT, duty + step);
+            ptMPPT->u8Direction = 1;
+        }
+        // If dP/dV = 0, we're at MPP, don't change duty cycle
+    }
+}
+
+// dP-P&O (Sera et al.): Pk is measured before the perturbation, Px half
+// way and P at the end of the interval, both halves equally long.
+// Px - Pk is the perturbation plus half of the irradiance change, P - Px
+// the other half alone, so on a linear ramp 2 Px - Pk - P is the effect of
+// the perturbation only. Called at the middle and at the end.
+static void dppo(tMPPT* ptMPPT, uint8_t u8Cycles)
+{
+    int32_t delta_power, delta_voltage, ramp;
+
+    if (!ptMPPT->u8Half)
+    {
+        // Middle of the interval, measured only
+        ptMPPT->i32MidPower = ptMPPT->i32Power;
+        ptMPPT->i32MidVoltage = ptMPPT->i32Voltage;
+        ptMPPT->u8Half = u8Cycles;
+
+        // Both halves are measured by a Kalman estimate started at their beginning
+        restart_estimates(ptMPPT);
+        return;
+    }
+
+    ptMPPT->u8Half = 0;
+    delta_power = 2 * ptMPPT->i32MidPower - ptMPPT->i32PrevPower - ptMPPT->i32Power;
+    delta_voltage = 2 * ptMPPT->i32MidVoltage - ptMPPT->i32PrevVoltage - ptMPPT->i32Voltage;
+
+    // Without a ramp the second half only costs time: until the power
+    // keeps moving again, perturb as often as plain P&O
+    ramp = ptMPPT->i32Power - ptMPPT->i32MidPower;
+    if (ramp < 0) ramp = -ramp;
+    if (ramp * DPPO_RAMP_RATIO < (delta_power < 0 ? -delta_power : delta_power))
+        ptMPPT->u8Plain = DPPO_PLAIN;
+
+    po_step(ptMPPT, delta_power, delta_voltage);
+
+    ptMPPT->i32PrevPower = ptMPPT->i32Power;
+    ptMPPT->i32PrevVoltage = ptMPPT->i32Voltage;
+    ptMPPT->i32PrevCurrent = ptMPPT->i32Current;
+}
+
+// Settling gate: the converter and the filters have settled once the power
+// moved by less than u16SettleTol per mille in each of the last
+// u8SettleSteps cycles. A window shorter than the filter would pass while
+// a small step is still being averaged in.
+static uint8_t settled(tMPPT* ptMPPT)
+{
+    int32_t delta = ptMPPT->i32Power - ptMPPT->i32LastPower;
+
+    ptMPPT->i32LastPower = ptMPPT->i32Power;
+    if (ptMPPT->u16SettleTol == 0)
+        return 0;
+
+    if (delta < 0) delta = -delta;
+    if ((int64_t)delta * 1000 <= (int64_t)ptMPPT->i32Power * ptMPPT->u16SettleTol)
+    {
+        if (ptMPPT->u8Steady < 255)
+            ptMPPT->u8Steady++;
+    }
+    else
+    {
+        ptMPPT->u8Steady = 0;
+    }
+
+    return ptMPPT->u8Steady >= ptMPPT->u8SettleSteps;
+}
+
+void mppt_algorithm(tMPPT* ptMPPT)
+{
+    uint8_t cycles, timeout, next;
+
+    ptMPPT->i32Power = sensor_power_mw(ptMPPT->i32Voltage, ptMPPT->i32Current);
+
+    // Every measurement of a search comes from refilled filters, no delay
+    if (ptMPPT->u8Searching)
+    {
+        search_step(ptMPPT);
+        return;
+    }
+
+    ptMPPT->u8Counter++;
+    cycles = ptMPPT->u8Counter;
+
+    // Next perturbation once steady, u8Delay is the timeout for a power
+    // that keeps moving (noise, irradiance ramps). A dP-P&O interval needs
+    // its two halves, so each half ends as soon as the gate could first
+    // pass, and the second is as long as the first.
+    timeout = ptMPPT->u8Delay;
+    if (ptMPPT->u8Mode == MPPT_MODE_DPPO && !ptMPPT->u8Plain && ptMPPT->u16SettleTol && ptMPPT->u8SettleSteps < timeout)
+        timeout = ptMPPT->u8SettleSteps;
+
+    next = settled(ptMPPT);
+    if (!next && cycles >= timeout)
+    {
+        // A plain dP-P&O interval that never settled has seen a ramp
+        next = 1;
+        ptMPPT->u8Plain = 0;
+    }
+    if (ptMPPT->u8Half)
+        next = cycles >= ptMPPT->u8Half;
+
+    if (next)
+    {
+        ptMPPT->u8Counter = 0;
+        ptMPPT->u8Steady = 0;
+
+        if (ptMPPT->u8FastStart)
+        {
+            fast_start(ptMPPT);
+            return;
+        }
+
+        if (!ptMPPT->u8Enabled)
+        {
+            ptMPPT->i32PrevPower = ptMPPT->i32Power;
+            ptMPPT->i32PrevVoltage = ptMPPT->i32Voltage;
+            ptMPPT->i32PrevCurrent = ptMPPT->i32Current;
+            ptMPPT->u8Enabled = 1;
+
+            // IncCond holds while nothing changes, so it gets a first
+            // perturbation to move off the starting duty. dP-P&O measures
+            // its effect over the next interval.
+            if (ptMPPT->u8Mode != MPPT_MODE_PO)
+            {
+                if (ptMPPT->u8Direction)
+                    set_duty_cycle(ptMPPT, ptMPPT->u16Duty + ptMPPT->u16DutyStep);
+                else
+                    set_duty_cycle(ptMPPT, ptMPPT->u16Duty - ptMPPT->u16DutyStep);
+            }
+            return;
+        }
+
+        // A large power jump between decisions (shading, cloud edge) means
+        // the local peak may no longer be the global one
+        if (ptMPPT->u8Particles && ptMPPT->u16SearchTrigger && ptMPPT->i32PrevPower > 0)
+        {
+            int32_t jump = ptMPPT->i32Power - ptMPPT->i32PrevPower;
+            if (jump < 0) jump = -jump;
+
+            if ((int64_t)jump * 1000 > (int64_t)ptMPPT->i32PrevPower * ptMPPT->u16SearchTrigger)
+            {
+                search_start(ptMPPT);
+                return;
+            }
+        }
+
+        if (ptMPPT->u8Mode == MPPT_MODE_DPPO && !ptMPPT->u8Plain)
+        {
+            dppo(ptMPPT, cycles);
+            return;
+        }
+
+        if (ptMPPT->u8Mode == MPPT_MODE_INCCOND)
+        {
+            inccond(ptMPPT, ptMPPT->i32Voltage - ptMPPT->i32PrevVoltage,
+                    ptMPPT->i32Current - ptMPPT->i32PrevCurrent);
+
+            ptMPPT->i32PrevPower = ptMPPT->i32Power;
+            ptMPPT->i32PrevVoltage = ptMPPT->i32Voltage;
+            ptMPPT->i32PrevCurrent = ptMPPT->i32Current;
+            return;
+        }
+
+        if (ptMPPT->u8Plain)
+            ptMPPT->u8Plain--;
+
+        // P&O Algorithm Implementation
+        po_step(ptMPPT, ptMPPT->i32Power - ptMPPT->i32PrevPower,
+                ptMPPT->i32Voltage - ptMPPT->i32PrevVoltage);
+
+        ptMPPT->i32PrevPower = ptMPPT->i32Power;
+        ptMPPT->i32PrevVoltage = ptMPPT->i32Voltage;
+        ptMPPT->i32PrevCurrent = ptMPPT->i32Current;
+    }
+}
+
+// Cascade output: the operating point as a PV voltage reference for an inner
+// voltage loop instead of a duty cycle. More duty means a lower PV voltage,
+// so the reference falls by u16VrefStep per count and every algorithm above
+// runs unchanged on its duty window.
+int32_t mppt_vref_mv(const tMPPT* ptMPPT)
+{
+    return ptMPPT->i32VrefMax - (int32_t)(ptMPPT->u16Duty - ptMPPT->u16MinDuty) * ptMPPT->u16VrefStep;
+}
+
+// Cascade anti-windup: while the inner loop sits at a duty limit the PV
+// voltage no longer follows the reference, and a perturbation that moves
+// only the reference changes nothing the MPPT can measure. Call this then
+// to restart the reference from the measured voltage. With u16VrefStep 0
+// the reference does not follow the duty, there is nothing to restart.
+void mppt_vref_sync(tMPPT* ptMPPT)
+{
+    int32_t counts;
+
+    if (ptMPPT->u16VrefStep == 0)
+        return;
+
+    counts = (ptMPPT->i32VrefMax - ptMPPT->i32Voltage) / ptMPPT->u16VrefStep;
+    set_duty_cycle(ptMPPT, ptMPPT->u16MinDuty + counts);
+}
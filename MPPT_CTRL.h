@@ -0,0 +1,119 @@
+#ifndef MPPT_CTRL_H
+#define MPPT_CTRL_H
+
+#include <stdint.h>
+#include "ADC_FILTER.h"
+
+#ifndef MPPT_FILTER_MAX
+#define MPPT_FILTER_MAX 200     // Filter buffer capacity per channel
+#endif
+
+#ifndef MPPT_PSO_MAX
+#define MPPT_PSO_MAX 5          // Global search particles
+#endif
+
+#define MPPT_CH_VOLTAGE 0       // A10 - Voltage sensor
+#define MPPT_CH_CURRENT 1       // A7 - Current sensor
+
+#define MPPT_FAST_OFF       0   // Fast start phases
+#define MPPT_FAST_REF       1   // At u16MinDuty, measuring the PV voltage
+#define MPPT_FAST_SEEK      2   // Duty jumps towards u16FocvK of it
+#define MPPT_FAST_PROBE     3   // One u16DutyStep up first, the MPP is near u16MinDuty if that loses
+
+#define MPPT_FAST_JUMPS     4   // Jumps before the tracker takes over anyway
+#define MPPT_FAST_SLOPE     2   // Least relative dP/dV of the probe, (dP/P)/(dV/V), for a jump
+
+#define MPPT_EST_BOXCAR     0   // Measurement: u16FilterSize moving average
+#define MPPT_EST_KALMAN     1   // Scalar Kalman per channel, restarted on every duty change
+
+#define MPPT_MODE_PO        0   // Perturb and observe
+#define MPPT_MODE_INCCOND   1   // Incremental conductance
+#define MPPT_MODE_DPPO      2   // Drift-free P&O, a mid-interval measurement separates irradiance changes
+
+// MPPT controller, P&O, dP-P&O or IncCond with an optional particle swarm global search
+typedef struct {
+    uint16_t u16DutyStep;       // Duty cycle step size
+    uint16_t u16MinDuty;        // Minimum duty cycle
+    uint16_t u16MaxDuty;        // Maximum duty cycle
+    uint8_t u8Delay;            // Number of cycles to wait between MPPT adjustments, the timeout with the settling gate
+    uint16_t u16SettleTol;      // Settling gate: power change per cycle taken as steady, per mille, 0 = fixed u8Delay
+    uint8_t u8SettleSteps;      // Settling gate: steady cycles in a row, at least the filter window in cycles
+    uint16_t u16FilterSize;     // ADC filter window, up to MPPT_FILTER_MAX
+    uint8_t u8VoltRobust;       // Spike rejection ahead of the voltage average, FILTER_RAW, FILTER_MEDIAN or FILTER_HAMPEL
+    uint8_t u8CurrRobust;       // Same for the current
+    uint8_t u8RobustSize;       // Median / Hampel window, 3 or 5, anything else turns the spike filters off
+    uint8_t u8Estimator;        // MPPT_EST_BOXCAR or MPPT_EST_KALMAN, the global search always uses the boxcar
+    uint32_t u32KalmanQ;        // Kalman: input change per filter sample, variance (LSB^2, KALMAN_Q24())
+    uint32_t u32KalmanR;        // Kalman: noise of one filter sample, variance (LSB^2, KALMAN_Q24())
+    uint8_t u8OsBits;           // Oversampling: extra bits of the filter samples, up to DECIM_BITS_MAX, needs 4^n conversions each
+    uint16_t u16OsSamples;      // Oversampling: conversions per filter sample, rounded up to a power of two of at least 4^u8OsBits
+    uint8_t u8Mode;             // MPPT_MODE_PO, MPPT_MODE_INCCOND or MPPT_MODE_DPPO
+    uint16_t u16IncTol;         // IncCond: hold band for |dP/dV| / I, and power change that ends a hold, per mille
+    uint16_t u16StepScale;      // Variable step: counts per A of |dP/dV| (Q8), 0 = fixed u16DutyStep
+    uint16_t u16MinStep;        // Variable step: smallest step
+    uint16_t u16MaxStep;        // Variable step: largest step
+    uint8_t u8Particles;        // Global search: particles, up to MPPT_PSO_MAX, 0 = off
+    uint8_t u8SearchIter;       // Global search: iteration limit
+    uint16_t u16SearchFilter;   // Global search: ADC filter window while searching
+    uint16_t u16SearchTrigger;  // Global search: restart on a power change above this, per mille
+    uint16_t u16FocvK;          // Fast start: MPP voltage as a fraction of the PV voltage at u16MinDuty, per mille, 0 = off
+    uint16_t u16PwmPeriod;      // Fast start: PWM counts per period, maps a PV voltage to a duty
+    int32_t i32VrefMax;         // Cascade: PV voltage reference at u16MinDuty (mV), see mppt_vref_mv()
+    uint16_t u16VrefStep;       // Cascade: reference change per duty count (mV)
+
+    int32_t i32Voltage;         // PV voltage (mV)
+    int32_t i32Current;         // PV current (mA)
+    int32_t i32Power;           // PV power (mW)
+    int32_t i32PrevPower;
+    int32_t i32PrevVoltage;
+    int32_t i32PrevCurrent;
+    int32_t i32LastPower;       // Power of the previous cycle, settling gate
+    int32_t i32MidPower;        // dP-P&O: power and voltage in the middle of the interval
+    int32_t i32MidVoltage;
+
+    uint16_t u16Duty;           // Duty cycle output (TA1CCR1 counts)
+    uint16_t u16Step;           // Last step taken
+    uint8_t u8Counter;
+    uint8_t u8Steady;           // Steady cycles in a row
+    uint8_t u8Half;             // dP-P&O: cycles in the first half of the interval, 0 while in it
+    uint8_t u8Plain;            // dP-P&O: no ramp seen, plain P&O intervals until the power keeps moving
+    uint8_t u8FastStart;        // Fast start phase, MPPT_FAST_OFF when the tracker runs
+    uint8_t u8Jumps;            // Fast start: duty jumps so far
+    int32_t i32RefMv;           // Fast start: PV voltage at u16MinDuty (mV)
+    uint16_t u16FastDuty;       // Fast start: duty before the last jump
+    uint8_t u8Direction;        // 1 for increase, 0 for decrease
+    uint8_t u8Held;             // IncCond: the last decision left the duty where it was
+    int32_t i32HeldPower;       // IncCond: power when the duty was first left where it was
+    uint8_t u8Enabled;
+
+    uint8_t u8Searching;        // Global search running
+    uint8_t u8Particle;         // Particle being measured
+    uint8_t u8Iter;             // Search iteration
+    uint16_t u16Evals;          // Measurements taken by the last search
+    int16_t ai16Pos[MPPT_PSO_MAX];
+    int16_t ai16Vel[MPPT_PSO_MAX];
+    int16_t ai16Best[MPPT_PSO_MAX];
+    int32_t ai32BestPower[MPPT_PSO_MAX];
+    int16_t i16GlobalBest;
+    int32_t i32GlobalBestPower;
+    uint16_t u16Rng;
+
+    tFILTER tVoltFilter;
+    tFILTER tCurrFilter;
+    tKALMAN tVoltKalman;
+    tKALMAN tCurrKalman;
+    tDECIM tVoltDecim;
+    tDECIM tCurrDecim;
+    uint16_t au16VoltBuf[MPPT_FILTER_MAX];
+    uint16_t au16CurrBuf[MPPT_FILTER_MAX];
+} tMPPT;
+
+void mppt_rst(tMPPT* ptMPPT);
+void mppt_sample(tMPPT* ptMPPT, uint8_t u8Channel, uint16_t u16Adc);    // u16Adc has u8OsBits extra bits
+void mppt_sample_block(tMPPT* ptMPPT, const uint16_t *pu16Voltage, const uint16_t *pu16Current, uint16_t u16Count);
+uint8_t mppt_ready(tMPPT* ptMPPT);
+void mppt_algorithm(tMPPT* ptMPPT);
+int32_t mppt_vref_mv(const tMPPT* ptMPPT);
+void mppt_vref_sync(tMPPT* ptMPPT);
+
+#endif
@@ -0,0 +1,171 @@
+#include <stdint.h>
+#include "HAL.h"
+#include "MPPT_CTRL.h"
+#include "PI.h"
+#include "SENSOR.h"
+#include "TELEMETRY.h"
+
+// Cascaded MPPT: the MPPT of MPPT.c sets a PV voltage reference every
+// LOOP_MS and a PI in the ADC interrupt holds the PV voltage on it at the
+// control rate, so irradiance changes are taken out by the fast loop.
+
+#define PWM_PERIOD 1000         // PWM period for 1kHz frequency
+#define DUTY_STEP 10            // Reference step, DUTY_STEP * VREF_STEP = 4V
+#define MIN_DUTY 100            // Minimum duty cycle (10%), also the PI output limits
+#define MAX_DUTY 500            // Maximum duty cycle (50%)
+#define MPPT_DELAY 15           // Most MPPT steps between decisions, the settling gate timeout
+#define VREF_MAX 350000L        // PV voltage reference at MIN_DUTY (mV)
+#define VREF_STEP 400           // Reference change per MPPT count (mV)
+#define CONTROL_DECIM 1         // PWM periods per control step, 1kHz
+#define CONTROL_DT (CONTROL_DECIM * PWM_PERIOD / 1000000.0f)   // Control period (s), SMCLK 1MHz
+#define OUTER_BLOCK 64          // Control samples averaged into one MPPT filter sample
+#define BLOCKS_PER_STEP 2       // Filter samples per MPPT step
+#define FILTER_SIZE 4           // Moving average over block averages, 256 ms
+#define LOOP_MS 128             // MPPT step, OUTER_BLOCK * BLOCKS_PER_STEP control steps
+#define VOLT_ROBUST FILTER_HAMPEL   // Spike rejection ahead of the block averages: FILTER_RAW, FILTER_MEDIAN or FILTER_HAMPEL
+#define CURR_ROBUST FILTER_HAMPEL
+#define ROBUST_SIZE 3           // Median / Hampel window (blocks), delays the filter by ROBUST_SIZE / 2
+#define SETTLE_TOL 5            // Settling gate: decide once the power moves less than 0.5% per step, 0 = every MPPT_DELAY
+#define SETTLE_STEPS ((FILTER_SIZE + ROBUST_SIZE / 2 + BLOCKS_PER_STEP) / BLOCKS_PER_STEP)  // Steady steps in a row, filter window, median delay and one block
+#define MPPT_MODE MPPT_MODE_INCCOND  // MPPT_MODE_PO, MPPT_MODE_DPPO or MPPT_MODE_INCCOND
+#define INC_TOL 20              // IncCond hold band (2% of I)
+
+// Outer loop, its duty window is mapped to VREF_MAX .. VREF_MAX - 400 * VREF_STEP
+tMPPT myMPPT = {
+    .u16DutyStep = DUTY_STEP,
+    .u16MinDuty = MIN_DUTY,
+    .u16MaxDuty = MAX_DUTY,
+    .u8Delay = MPPT_DELAY,
+    .u16SettleTol = SETTLE_TOL,
+    .u8SettleSteps = SETTLE_STEPS,
+    .u16FilterSize = FILTER_SIZE,
+    .u8VoltRobust = VOLT_ROBUST,
+    .u8CurrRobust = CURR_ROBUST,
+    .u8RobustSize = ROBUST_SIZE,
+    .u8Mode = MPPT_MODE,
+    .u16IncTol = INC_TOL,
+    .i32VrefMax = VREF_MAX,
+    .u16VrefStep = VREF_STEP
+};
+
+// Inner PV voltage loop, error = V - Vref since more duty pulls the PV voltage down
+tPIQ myPIQ = {
+    .qKp = PI_Q24(0.001f),
+    .qKi = PI_Q24(25.5f),
+    .qDtSec = PI_Q24(CONTROL_DT),
+    .qUpOutLim = PI_Q24((float)MAX_DUTY / PWM_PERIOD),
+    .qLowOutLim = PI_Q24((float)MIN_DUTY / PWM_PERIOD)
+};
+
+volatile uint16_t duty_counts = MIN_DUTY;
+volatile uint16_t block_voltage = 0;
+volatile uint16_t block_current = 0;
+volatile uint8_t block_ready = 0;
+uint32_t time_ms = 0;
+uint8_t blocks = 0;
+
+tTELEM telem;
+uint8_t telem_buf[TELEM_FRAME_MAX];
+
+void uart_send_string(const char *str);
+void uart_send_char(char c);
+static void control_isr(uint16_t voltage, uint16_t current);
+
+int main(void)
+{
+    hal_init();
+    hal_uart_init();
+    hal_cpu_fast();
+
+    mppt_rst(&myMPPT);
+    tPIQ_rst(&myPIQ);
+    myPIQ.qOut = myPIQ.qIprevOut = myPIQ.qLowOutLim;   // Start from the minimum duty
+    hal_pwm_init(PWM_PERIOD - 1, MIN_DUTY);
+    hal_adc_timer_pair_init(control_isr, CONTROL_DECIM);
+
+    uart_send_string("Cascaded MPPT Initialized\r\n");
+    telem_init(&telem, TELEM_TYPE_PV, LOOP_MS);
+    uart_send_char(0);      // Frame delimiter, the decoder skips the banner
+
+    while(1)
+    {
+        uint16_t duty;
+
+        // Woken by every control interrupt, works once per block
+        hal_sleep();
+        if (!block_ready)
+            continue;
+        block_ready = 0;
+
+        mppt_sample(&myMPPT, MPPT_CH_VOLTAGE, block_voltage);
+        mppt_sample(&myMPPT, MPPT_CH_CURRENT, block_current);
+        if (++blocks < BLOCKS_PER_STEP)
+            continue;
+        blocks = 0;
+        time_ms += LOOP_MS;
+
+        if (mppt_ready(&myMPPT))
+        {
+            // A saturated inner loop no longer follows the reference
+            duty = duty_counts;
+            if (duty <= MIN_DUTY || duty >= MAX_DUTY)
+                mppt_vref_sync(&myMPPT);
+
+            // New reference, picked up by the next control interrupt
+            mppt_algorithm(&myMPPT);
+
+            if (myMPPT.u8Counter == 0 && myMPPT.i32Power > 100)
+                hal_led_toggle();
+
+            // Every step is logged with the duty the inner loop applies,
+            // 8 samples per frame, dropped whole when the TX buffer is full
+            if (telem_push(&telem, time_ms, myMPPT.i32Voltage, myMPPT.i32Current, duty))
+            {
+                uint16_t len = telem_frame(&telem, telem_buf);
+
+                if (hal_uart_tx_free() >= len)
+                {
+                    uint16_t i;
+
+                    for (i = 0; i < len; i++)
+                        uart_send_char((char)telem_buf[i]);
+                }
+            }
+        }
+    }
+}
+
+void uart_send_char(char c)
+{
+    hal_uart_putc(c);
+}
+
+void uart_send_string(const char *str)
+{
+    while (*str)
+        uart_send_char(*str++);
+}
+
+// ADC12 ISR work for every A10/A7 pair: one PI step on the PV voltage, and
+// the pairs summed into OUTER_BLOCK averages for the MPPT
+static void control_isr(uint16_t voltage, uint16_t current)
+{
+    static uint32_t sum_v = 0, sum_i = 0;
+    static uint8_t pairs = 0;
+
+    myPIQ.qIn = PI_MV_TO_Q16(sensor_voltage_mv(voltage) - mppt_vref_mv(&myMPPT));
+    tPIQ_calc(&myPIQ);
+    duty_counts = tPIQ_counts(myPIQ.qOut, PWM_PERIOD - 1);
+    hal_pwm_set(duty_counts);
+
+    sum_v += voltage;
+    sum_i += current;
+    if (++pairs >= OUTER_BLOCK)
+    {
+        block_voltage = (uint16_t)((sum_v + OUTER_BLOCK / 2) / OUTER_BLOCK);
+        block_current = (uint16_t)((sum_i + OUTER_BLOCK / 2) / OUTER_BLOCK);
+        block_ready = 1;
+        sum_v = sum_i = 0;
+        pairs = 0;
+    }
+}
@@ -0,0 +1,250 @@
+// Closed loop PC simulation of the MPPT and boost PI firmware, see SIM_LOOP.h.
+//
+// Build: gcc -O2 -o mppt_sim MPPT_SIM.c SIM_LOOP.c PV_SIM.c MPPT_CTRL.c PI.c ADC_FILTER.c SENSOR.c AUTOTUNE.c MPC.c -lm
+// Usage: ./mppt_sim [mode=mppt|pi|cascade] [key=value ...]
+//
+//   time=300        simulated seconds          G=0:1000,120:600   irradiance profile
+//   step=1e-4       plant step (s)             T=25               temperature profile
+//   noise=1         ADC noise (LSB)            seed=1             noise seed
+//   nser=10 npar=2  PV array (nser=0: DC src)  vdc=50             DC source voltage
+//   R=40            load (ohm)                 csv=out.csv        time series (- for stdout)
+//   ts=0.128        control sample period (s)  load=0:73,60:36    load profile (ohm)
+//   dstep=10 delay=15 filter=4 mind=100 maxd=500                  MPPT settings
+//   settle=0 settlen=3                                            settling gate (per mille, cycles), delay= is the timeout
+//   focv=850                                                      fast start at this fraction of the PV voltage at mind (per mille), 0 = off
+//   robust=hampel rsize=3                                         MPPT spike rejection ahead of the averages (raw|median|hampel), window
+//   est=boxcar kq=1e-6 kr=0.03                                    MPPT estimator (boxcar|kalman), Kalman variances per filter sample (12-bit LSB^2)
+//   osbits=0 ossamples=0                                          oversampling: extra bits of the filter samples, conversions per sample (0 = a block), a power of two of at least 4^osbits
+//   alg=po|inc|dppo inctol=20                                     MPPT algorithm (dppo: drift-free P&O)
+//   vscale=0 minstep=5 maxstep=50                                 variable step (vscale>0)
+//   pso=0 psoiter=10 psofilter=8 psotrig=200                      global search (pso=particles)
+//   shade=2:0.5,1:0.3 shadet=0                                    modules:irradiance factor, from time
+//   block=32 blocks=2                                             DMA pairs per block, blocks per step (block=0: one pair)
+//   kp=0.01 ki=10.5 vref=75 fixed=1 ff=0                          PI settings (ff=1: boost duty feedforward)
+//   tune=0 tuneamp=0.1 tunehyst=1000                              relay auto-tune at start (duty, mV)
+//   mpc=0 gv=0.25 go=0.02 wi=1 wdu=300 span=1                     MPC instead of the PI, observer gains, weights (mV per mA, per count)
+//   tstep=0                                                       overshoot, undershoot and 5% settling from this time (s)
+//   vrefmax=350000 vrefstep=400                                   cascade reference (mV at mind, mV per count)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "SIM_LOOP.h"
+
+// "t:v,t:v,..." or a single constant "v"
+static int parse_profile(tSIM_PROFILE* ptProfile, const char *str)
+{
+    ptProfile->u8Count = 0;
+
+    while (*str && ptProfile->u8Count < SIM_PROFILE_MAX)
+    {
+        char *end;
+        double a = strtod(str, &end);
+
+        if (end == str)
+            return -1;
+
+        if (*end == ':')
+        {
+            str = end + 1;
+            ptProfile->adTime[ptProfile->u8Count] = a;
+            ptProfile->adValue[ptProfile->u8Count] = strtod(str, &end);
+            if (end == str)
+                return -1;
+        }
+        else
+        {
+            ptProfile->adTime[ptProfile->u8Count] = 0.0;
+            ptProfile->adValue[ptProfile->u8Count] = a;
+        }
+
+        ptProfile->u8Count++;
+        str = *end == ',' ? end + 1 : end;
+    }
+
+    return ptProfile->u8Count ? 0 : -1;
+}
+
+// "modules:factor,modules:factor,..."
+static int parse_shade(tPV_SHADE* ptShade, const char *str)
+{
+    ptShade->u8Count = 0;
+
+    while (*str && ptShade->u8Count < PV_GROUP_MAX)
+    {
+        char *end;
+        long n = strtol(str, &end, 10);
+
+        if (end == str || *end != ':' || n <= 0)
+            return -1;
+        str = end + 1;
+
+        ptShade->au16Modules[ptShade->u8Count] = (uint16_t)n;
+        ptShade->adFactor[ptShade->u8Count] = strtod(str, &end);
+        if (end == str)
+            return -1;
+
+        ptShade->u8Count++;
+        str = *end == ',' ? end + 1 : end;
+    }
+
+    return ptShade->u8Count ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    tSIM_CFG cfg;
+    tSIM_RESULT res;
+    FILE *csv = 0, *out;
+    const char *csv_name = 0;
+    clock_t start;
+    double wall;
+    int i;
+
+    sim_default_mppt(&cfg);
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "mode=pi") == 0)
+            sim_default_pi(&cfg);
+        else if (strcmp(argv[i], "mode=cascade") == 0)
+            sim_default_cascade(&cfg);
+    }
+
+    for (i = 1; i < argc; i++)
+    {
+        char *val = strchr(argv[i], '=');
+        const char *key = argv[i];
+
+        if (!val)
+        {
+            fprintf(stderr, "bad argument '%s'\n", argv[i]);
+            return 2;
+        }
+        *val++ = '\0';
+
+        if (strcmp(key, "mode") == 0) { if (strcmp(val, "pi") && strcmp(val, "mppt") && strcmp(val, "cascade")) { fprintf(stderr, "bad mode\n"); return 2; } }
+        else if (strcmp(key, "time") == 0) cfg.dDuration = atof(val);
+        else if (strcmp(key, "step") == 0) cfg.dH = atof(val);
+        else if (strcmp(key, "ts") == 0) cfg.dSamplePeriod = atof(val);
+        else if (strcmp(key, "noise") == 0) cfg.dNoiseLsb = atof(val);
+        else if (strcmp(key, "seed") == 0) cfg.u32Seed = (uint32_t)strtoul(val, 0, 0);
+        else if (strcmp(key, "nser") == 0) cfg.u16Nser = (uint16_t)atoi(val);
+        else if (strcmp(key, "npar") == 0) cfg.u16Npar = (uint16_t)atoi(val);
+        else if (strcmp(key, "vdc") == 0) cfg.tBoost.dVdc = atof(val);
+        else if (strcmp(key, "R") == 0) cfg.tBoost.dR = atof(val);
+        else if (strcmp(key, "dstep") == 0) cfg.tMpptSet.u16DutyStep = (uint16_t)atoi(val);
+        else if (strcmp(key, "delay") == 0) cfg.tMpptSet.u8Delay = (uint8_t)atoi(val);
+        else if (strcmp(key, "settle") == 0) cfg.tMpptSet.u16SettleTol = (uint16_t)atoi(val);
+        else if (strcmp(key, "focv") == 0) cfg.tMpptSet.u16FocvK = (uint16_t)atoi(val);
+        else if (strcmp(key, "robust") == 0) cfg.tMpptSet.u8VoltRobust = cfg.tMpptSet.u8CurrRobust =
+                                                        strcmp(val, "median") == 0 ? FILTER_MEDIAN :
+                                                        strcmp(val, "hampel") == 0 ? FILTER_HAMPEL : FILTER_RAW;
+        else if (strcmp(key, "est") == 0) cfg.tMpptSet.u8Estimator = strcmp(val, "kalman") == 0 ? MPPT_EST_KALMAN : MPPT_EST_BOXCAR;
+        else if (strcmp(key, "kq") == 0) cfg.tMpptSet.u32KalmanQ = KALMAN_Q24(atof(val));
+        else if (strcmp(key, "kr") == 0) cfg.tMpptSet.u32KalmanR = KALMAN_Q24(atof(val));
+        else if (strcmp(key, "osbits") == 0) cfg.tMpptSet.u8OsBits = (uint8_t)atoi(val);
+        else if (strcmp(key, "ossamples") == 0) cfg.tMpptSet.u16OsSamples = (uint16_t)atoi(val);
+        else if (strcmp(key, "rsize") == 0) cfg.tMpptSet.u8RobustSize = (uint8_t)atoi(val);
+        else if (strcmp(key, "settlen") == 0) cfg.tMpptSet.u8SettleSteps = (uint8_t)atoi(val);
+        else if (strcmp(key, "filter") == 0) { cfg.tMpptSet.u16FilterSize = (uint16_t)atoi(val); cfg.u16PiFilterSize = cfg.tMpptSet.u16FilterSize; }
+        else if (strcmp(key, "mind") == 0) cfg.tMpptSet.u16MinDuty = (uint16_t)atoi(val);
+        else if (strcmp(key, "maxd") == 0) cfg.tMpptSet.u16MaxDuty = (uint16_t)atoi(val);
+        else if (strcmp(key, "alg") == 0) cfg.tMpptSet.u8Mode = strcmp(val, "inc") == 0 ? MPPT_MODE_INCCOND :
+                                                        strcmp(val, "dppo") == 0 ? MPPT_MODE_DPPO : MPPT_MODE_PO;
+        else if (strcmp(key, "inctol") == 0) cfg.tMpptSet.u16IncTol = (uint16_t)atoi(val);
+        else if (strcmp(key, "vscale") == 0) cfg.tMpptSet.u16StepScale = (uint16_t)atoi(val);
+        else if (strcmp(key, "minstep") == 0) cfg.tMpptSet.u16MinStep = (uint16_t)atoi(val);
+        else if (strcmp(key, "maxstep") == 0) cfg.tMpptSet.u16MaxStep = (uint16_t)atoi(val);
+        else if (strcmp(key, "pso") == 0) cfg.tMpptSet.u8Particles = (uint8_t)atoi(val);
+        else if (strcmp(key, "psoiter") == 0) cfg.tMpptSet.u8SearchIter = (uint8_t)atoi(val);
+        else if (strcmp(key, "psofilter") == 0) cfg.tMpptSet.u16SearchFilter = (uint16_t)atoi(val);
+        else if (strcmp(key, "psotrig") == 0) cfg.tMpptSet.u16SearchTrigger = (uint16_t)atoi(val);
+        else if (strcmp(key, "block") == 0) cfg.u16AdcBlock = (uint16_t)atoi(val);
+        else if (strcmp(key, "blocks") == 0) cfg.u16AdcBlocks = (uint16_t)atoi(val);
+        else if (strcmp(key, "shadet") == 0) cfg.dShadeTime = atof(val);
+        else if (strcmp(key, "shade") == 0 && parse_shade(&cfg.tShade, val) == 0) ;
+        else if (strcmp(key, "kp") == 0) cfg.tPiSet.fKp = (float)atof(val);
+        else if (strcmp(key, "ki") == 0) cfg.tPiSet.fKi = (float)atof(val);
+        else if (strcmp(key, "vref") == 0) cfg.fVref = (float)atof(val);
+        else if (strcmp(key, "fixed") == 0) cfg.u8Fixed = (uint8_t)atoi(val);
+        else if (strcmp(key, "ff") == 0) cfg.u8Feedforward = (uint8_t)atoi(val);
+        else if (strcmp(key, "mpc") == 0) cfg.u8Mpc = (uint8_t)atoi(val);
+        else if (strcmp(key, "gv") == 0) cfg.tMpcSet.qGv = MPC_Q8((float)atof(val));
+        else if (strcmp(key, "go") == 0) cfg.tMpcSet.qGo = MPC_Q16((float)atof(val));
+        else if (strcmp(key, "wi") == 0) cfg.tMpcSet.qWi = MPC_Q8((float)atof(val));
+        else if (strcmp(key, "wdu") == 0) cfg.tMpcSet.i32WduMv = atol(val);
+        else if (strcmp(key, "span") == 0) cfg.tMpcSet.u8Span = (uint8_t)atoi(val);
+        else if (strcmp(key, "tstep") == 0) cfg.dStepTime = atof(val);
+        else if (strcmp(key, "tune") == 0) cfg.u8Tune = (uint8_t)atoi(val);
+        else if (strcmp(key, "tuneamp") == 0) cfg.tTuneSet.qAmp = PI_Q24((float)atof(val));
+        else if (strcmp(key, "tunehyst") == 0) cfg.tTuneSet.i32HystMv = atol(val);
+        else if (strcmp(key, "vrefmax") == 0) cfg.tMpptSet.i32VrefMax = atol(val);
+        else if (strcmp(key, "vrefstep") == 0) cfg.tMpptSet.u16VrefStep = (uint16_t)atoi(val);
+        else if (strcmp(key, "csv") == 0) csv_name = val;
+        else if ((strcmp(key, "G") == 0 && parse_profile(&cfg.tIrradiance, val) == 0) ||
+                 (strcmp(key, "T") == 0 && parse_profile(&cfg.tTemperature, val) == 0) ||
+                 (strcmp(key, "load") == 0 && parse_profile(&cfg.tLoad, val) == 0)) ;
+        else
+        {
+            fprintf(stderr, "bad argument '%s=%s'\n", key, val);
+            return 2;
+        }
+    }
+
+    if (cfg.u16Nser && !cfg.u16Npar)
+        cfg.u16Npar = 1;
+    if (cfg.tMpptSet.u16FilterSize > MPPT_FILTER_MAX)
+        cfg.tMpptSet.u16FilterSize = MPPT_FILTER_MAX;
+    if (cfg.tMpptSet.u8OsBits > DECIM_BITS_MAX)
+        cfg.tMpptSet.u8OsBits = DECIM_BITS_MAX;
+
+    // The Kalman works on the oversampled codes, 4^n of their LSB^2 per 12-bit LSB^2
+    cfg.tMpptSet.u32KalmanQ <<= 2 * cfg.tMpptSet.u8OsBits;
+    cfg.tMpptSet.u32KalmanR <<= 2 * cfg.tMpptSet.u8OsBits;
+
+    if (csv_name)
+    {
+        csv = strcmp(csv_name, "-") == 0 ? stdout : fopen(csv_name, "w");
+        if (!csv)
+        {
+            perror(csv_name);
+            return 1;
+        }
+    }
+
+    start = clock();
+    sim_run(&cfg, &res, csv);
+    wall = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    if (csv && csv != stdout)
+        fclose(csv);
+
+    out = csv == stdout ? stderr : stdout;
+    fprintf(out, "simulated %.1f s in %.3f s (%.0fx real time), %lu samples\n",
+            cfg.dDuration, wall, wall > 0.0 ? cfg.dDuration / wall : 0.0,
+            (unsigned long)res.u32Samples);
+    if (res.dEnergyMpp > 0.0)
+        fprintf(out, "energy %.1f J of %.1f J available, tracking efficiency %.2f%%\n",
+                res.dEnergy, res.dEnergyMpp, res.dEfficiency * 100.0);
+    fprintf(out, "settled at %.3f s, duty ripple %.3f, final Ppv %.1f W, Vout %.2f V\n",
+            res.dSettleTime, res.dDutyRipple, res.dPower, res.dVout);
+    if (cfg.u8Mode != SIM_MODE_PI)
+        fprintf(out, "longest time below 95%% of the MPP once tracking %.3f s\n", res.dRecoverTime);
+    if (cfg.u8Mode == SIM_MODE_PI)
+    {
+        fprintf(out, "largest Vout deviation once settled %.2f V\n", res.dVoutDev);
+        fprintf(out, "from %.3f s: overshoot %.2f V, undershoot %.2f V, within 5%% after %.4f s\n",
+                cfg.dStepTime, res.dOvershoot, res.dUndershoot, res.dSettle5);
+    }
+    if (cfg.u8Tune)
+    {
+        if (res.u8Tuned)
+            fprintf(out, "relay tune done at %.3f s: Ku %.4f, Tu %.4f s -> kp %.4f ki %.2f\n",
+                    res.dTuneTime, res.fKu, res.fTu, res.fKp, res.fKi);
+        else
+            fprintf(out, "relay tune failed at %.3f s, tPiSet gains kept\n", res.dTuneTime);
+    }
+
+    return 0;
+}
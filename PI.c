@@ -0,0 +1,188 @@
+#include "PI.h"
+
+// PI Controller
+
+void tPI_calc(tPI* ptPI)
+{
+    float fPreOut;
+
+    ptPI->fPout = ptPI->fIn * ptPI->fKp;
+
+
+    if ((ptPI->fOut < ptPI->fUpOutLim && ptPI->fOut > ptPI->fLowOutLim) ||
+        (ptPI->fIn < 0 && ptPI->fOut >= ptPI->fUpOutLim) ||
+        (ptPI->fIn > 0 && ptPI->fOut <= ptPI->fLowOutLim))
+    {
+        ptPI->fIout = ptPI->fIprevOut + 0.5f * ptPI->fDtSec *
+            (ptPI->fPout * ptPI->fKi + ptPI->fIprevIn);
+    }
+    else
+    {
+        ptPI->fIout = ptPI->fIprevOut;
+    }
+
+    ptPI->fIprevIn = ptPI->fPout * ptPI->fKi;
+    ptPI->fIprevOut = ptPI->fIout;
+
+    fPreOut = ptPI->fPout + ptPI->fIout + ptPI->fFf;
+
+
+    if (fPreOut > ptPI->fUpOutLim) fPreOut = ptPI->fUpOutLim;
+    if (fPreOut < ptPI->fLowOutLim) fPreOut = ptPI->fLowOutLim;
+
+    ptPI->fOut = fPreOut;
+}
+
+
+// PI controller reset
+void tPI_rst(tPI* ptPI)
+{
+    ptPI->fIn = 0.0f;
+    ptPI->fIout = 0.0f;
+    ptPI->fIprevIn = 0.0f;
+    ptPI->fIprevOut = 0.0f;
+    ptPI->fOut = 0.0f;
+    ptPI->fPout = 0.0f;
+    ptPI->fFf = 0.0f;
+}
+
+// Ideal CCM boost duty D = 1 - Vin/Vout as the feedforward, so the integral
+// only has to cover the losses instead of the whole steady-state duty.
+// fOut stays the clamped sum, so the anti-windup above stops integrating
+// when the feedforward alone already drives the output into a limit.
+float tPI_boost_ff(float fVin, float fVout)
+{
+    if (fVout <= 0.0f || fVin >= fVout)
+        return 0.0f;
+    if (fVin <= 0.0f)
+        return 1.0f;
+
+    return 1.0f - fVin / fVout;
+}
+
+// PWM compare count for a duty cycle, shared by the firmware and SIM_LOOP.
+// The timer counts 0 .. ccr0, so the period is ccr0 + 1 counts and a duty
+// of 1 is ccr0 + 1, the output always on.
+uint16_t tPI_counts(float fDuty, uint16_t u16Ccr0)
+{
+    if (fDuty <= 0.0f)
+        return 0;
+    if (fDuty >= 1.0f)
+        return u16Ccr0 + 1;
+
+    return (uint16_t)(fDuty * (u16Ccr0 + 1.0f));
+}
+
+// Fixed point PI Controller
+
+// (a * b + 0.5 LSB) >> shift, saturated, for 16 <= shift < 32, built from
+// 16 x 16 -> 32 bit partial products and 32 bit adds only. The MSP430
+// hardware multiplier does each partial product in one go, an int64_t
+// multiply, shift and saturation go through the runtime library. Bit exact
+// with the 64 bit arithmetic shift, negative results round the same way.
+static int32_t pi_mul(int32_t a, int32_t b, uint8_t shift)
+{
+    uint32_t ua = a < 0 ? 0UL - (uint32_t)a : (uint32_t)a;
+    uint32_t ub = b < 0 ? 0UL - (uint32_t)b : (uint32_t)b;
+    uint16_t ah = (uint16_t)(ua >> 16), al = (uint16_t)ua;
+    uint16_t bh = (uint16_t)(ub >> 16), bl = (uint16_t)ub;
+    uint8_t neg = (a < 0) != (b < 0);
+    uint32_t hi, lo, mid, sum;
+
+    hi = (uint32_t)ah * bh;
+    lo = (uint32_t)al * bl;
+
+    mid = (uint32_t)ah * bl;
+    sum = lo + (mid << 16);
+    hi += (mid >> 16) + (sum < lo);
+    lo = sum;
+
+    mid = (uint32_t)al * bh;
+    sum = lo + (mid << 16);
+    hi += (mid >> 16) + (sum < lo);
+    lo = sum;
+
+    // Floor of (-m + half) is -(m + half - 1) >> shift
+    sum = lo + (1UL << (shift - 1)) - neg;
+    hi += (sum < lo);
+    lo = sum;
+
+    if (hi >> (shift - 1))
+        return neg ? INT32_MIN : INT32_MAX;
+
+    lo = (hi << (32 - shift)) | (lo >> shift);
+    return neg ? (int32_t)(0UL - lo) : (int32_t)lo;
+}
+
+static int32_t pi_add(int32_t a, int32_t b)
+{
+    if (b > 0 && a > INT32_MAX - b) return INT32_MAX;
+    if (b < 0 && a < INT32_MIN - b) return INT32_MIN;
+    return a + b;
+}
+
+void tPIQ_calc(tPIQ* ptPI)
+{
+    int32_t qPreOut;
+    int32_t qPKi;
+
+    // Q16 * Q24 >> 16 = Q24
+    ptPI->qPout = pi_mul(ptPI->qIn, ptPI->qKp, PI_QIN);
+    qPKi = pi_mul(ptPI->qPout, ptPI->qKi, PI_QC);
+
+    if ((ptPI->qOut < ptPI->qUpOutLim && ptPI->qOut > ptPI->qLowOutLim) ||
+        (ptPI->qIn < 0 && ptPI->qOut >= ptPI->qUpOutLim) ||
+        (ptPI->qIn > 0 && ptPI->qOut <= ptPI->qLowOutLim))
+    {
+        // Trapezoidal step, 0.5 * Dt folded into the final shift
+        ptPI->qIout = pi_add(ptPI->qIprevOut,
+            pi_mul(pi_add(qPKi, ptPI->qIprevIn), ptPI->qDtSec, PI_QC + 1));
+    }
+    else
+    {
+        ptPI->qIout = ptPI->qIprevOut;
+    }
+
+    ptPI->qIprevIn = qPKi;
+    ptPI->qIprevOut = ptPI->qIout;
+
+    qPreOut = pi_add(pi_add(ptPI->qPout, ptPI->qIout), ptPI->qFf);
+
+    if (qPreOut > ptPI->qUpOutLim) qPreOut = ptPI->qUpOutLim;
+    if (qPreOut < ptPI->qLowOutLim) qPreOut = ptPI->qLowOutLim;
+
+    ptPI->qOut = qPreOut;
+}
+
+// Fixed point PI controller reset
+void tPIQ_rst(tPIQ* ptPI)
+{
+    ptPI->qIn = 0;
+    ptPI->qIout = 0;
+    ptPI->qIprevIn = 0;
+    ptPI->qIprevOut = 0;
+    ptPI->qOut = 0;
+    ptPI->qPout = 0;
+    ptPI->qFf = 0;
+}
+
+// tPI_boost_ff() in Q24 from millivolts, one 64 bit division
+uint16_t tPIQ_counts(int32_t qDuty, uint16_t u16Ccr0)
+{
+    if (qDuty <= 0)
+        return 0;
+    if (qDuty >= (1L << PI_QC))
+        return u16Ccr0 + 1;
+
+    return (uint16_t)pi_mul(qDuty, (int32_t)u16Ccr0 + 1, PI_QC);
+}
+
+int32_t tPIQ_boost_ff(int32_t i32VinMv, int32_t i32VoutMv)
+{
+    if (i32VoutMv <= 0 || i32VinMv >= i32VoutMv)
+        return 0;
+    if (i32VinMv <= 0)
+        return 1L << PI_QC;
+
+    return (int32_t)((((int64_t)(i32VoutMv - i32VinMv) << PI_QC) + i32VoutMv / 2) / i32VoutMv);
+}
@@ -0,0 +1,58 @@
+#ifndef PI_H
+#define PI_H
+
+#include <stdint.h>
+
+// PI Controller
+typedef struct {
+    float fIn;         // Error
+    float fKp;         // Proportional gain
+    float fKi;         // Integral gain, 1 / Ti: the integral output is Kp * Ki * integral of the error
+    float fDtSec;
+    float fFf;         // Feedforward added before the clamp, e.g. tPI_boost_ff(), 0 = none
+
+    float fPout;       // Proportional output
+    float fIout;       // Integral output
+    float fIprevIn;    // Previous fPout * fKi (for integration)
+    float fIprevOut;   // Previous integral output
+
+    float fOut;        // Controller output (duty cycle)
+    float fUpOutLim;   // Upper output limit (e.g., 1.0)
+    float fLowOutLim;  // Lower output limit (e.g., 0.0)
+} tPI;
+
+// Fixed point PI Controller, same structure as tPI.
+// The error input is Q16 (volts), gains, sample time, outputs and limits are Q24.
+#define PI_QIN 16
+#define PI_QC  24
+#define PI_Q16(f) ((int32_t)((f) * 65536.0f + ((f) >= 0 ? 0.5f : -0.5f)))
+#define PI_Q24(f) ((int32_t)((f) * 16777216.0f + ((f) >= 0 ? 0.5f : -0.5f)))
+#define PI_MV_TO_Q16(mv) ((int32_t)(((int64_t)(mv) * 67109) >> 10))   // mV * 65.536
+
+typedef struct {
+    int32_t qIn;         // Error (Q16)
+    int32_t qKp;         // Proportional gain (Q24)
+    int32_t qKi;         // Integral gain (Q24)
+    int32_t qDtSec;      // Sampling interval (Q24)
+    int32_t qFf;         // Feedforward added before the clamp (Q24), 0 = none
+
+    int32_t qPout;       // Proportional output (Q24)
+    int32_t qIout;       // Integral output (Q24)
+    int32_t qIprevIn;    // Previous qPout * qKi (Q24)
+    int32_t qIprevOut;   // Previous integral output (Q24)
+
+    int32_t qOut;        // Controller output (Q24)
+    int32_t qUpOutLim;   // Upper output limit (Q24)
+    int32_t qLowOutLim;  // Lower output limit (Q24)
+} tPIQ;
+
+void tPI_calc(tPI* ptPI);
+void tPI_rst(tPI* ptPI);
+float tPI_boost_ff(float fVin, float fVout);
+uint16_t tPI_counts(float fDuty, uint16_t u16Ccr0);       // PWM compare count, period ccr0 + 1
+void tPIQ_calc(tPIQ* ptPI);
+void tPIQ_rst(tPIQ* ptPI);
+int32_t tPIQ_boost_ff(int32_t i32VinMv, int32_t i32VoutMv);
+uint16_t tPIQ_counts(int32_t qDuty, uint16_t u16Ccr0);    // Q24 duty, same as tPI_counts()
+
+#endif
@@ -0,0 +1,172 @@
+// Host regression test and benchmark for the float and fixed point PI (not for the MSP430)
+// Build: gcc -O2 -o pi_bench PI_BENCH.c PI.c -lm
+// Usage: ./pi_bench
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include "PI.h"
+
+#define STEPS 20000
+#define TIMING_ROUNDS 200
+
+// FNV-1a hash of every fixed point output. Integer math only, so any change
+// to tPIQ_calc that alters a single output bit changes this value.
+#define GOLDEN_HASH 0x7D59F136u
+
+typedef struct {
+    const char *name;
+    float fKp, fKi, fDtSec, fUpOutLim, fLowOutLim;
+} tCASE;
+
+static const tCASE cases[] = {
+    { "slow integral, 2 Hz",              0.05f, 0.005f, 0.5f,    0.4f, 0.0f },
+    { "same gains, 10 kHz",               0.05f, 0.005f, 0.0001f, 0.4f, 0.0f },
+    { "stiff gains, 1 kHz",               0.5f,  2.0f,   0.001f,  0.9f, 0.0f },
+};
+
+// Error sequences in volts: step, ramp, triangle, square and pseudo-random noise.
+// No libm calls, so the fixed point inputs are identical on every host.
+static float error_at(uint8_t seq, uint32_t k)
+{
+    static uint32_t lfsr = 0xACE1u;
+
+    switch (seq) {
+        case 0: return (k < STEPS / 2) ? 10.0f : -10.0f;
+        case 1: return 75.0f - 150.0f * k / STEPS;
+        case 2: return 5.0f - (float)abs((int)(k % 400) - 200) / 20.0f;
+        case 3: return ((k / 500) & 1) ? 300.0f : -300.0f;
+        default:
+            lfsr = lfsr * 1664525u + 1013904223u;
+            return ((int32_t)(lfsr >> 16) - 32768) / 3276.8f;
+    }
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void)
+{
+    uint32_t hash = 2166136261u;
+    double worst = 0;
+    uint8_t c, seq;
+    uint32_t k, r;
+    float errors[STEPS];
+    int32_t qErrors[STEPS];
+
+    for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        tPI fpi = { .fKp = cases[c].fKp, .fKi = cases[c].fKi, .fDtSec = cases[c].fDtSec,
+                    .fUpOutLim = cases[c].fUpOutLim, .fLowOutLim = cases[c].fLowOutLim };
+        tPIQ qpi = { .qKp = PI_Q24(cases[c].fKp), .qKi = PI_Q24(cases[c].fKi),
+                     .qDtSec = PI_Q24(cases[c].fDtSec), .qUpOutLim = PI_Q24(cases[c].fUpOutLim),
+                     .qLowOutLim = PI_Q24(cases[c].fLowOutLim) };
+        double t0, t_float, t_fixed;
+        volatile float fsink = 0;
+        volatile int32_t qsink = 0;
+
+        printf("%s\n", cases[c].name);
+
+        for (seq = 0; seq < 5; seq++) {
+            double max_dev = 0;
+
+            tPI_rst(&fpi);
+            tPIQ_rst(&qpi);
+
+            for (k = 0; k < STEPS; k++) {
+                // Both controllers see the same (Q16 representable) error
+                qErrors[k] = PI_Q16(error_at(seq, k));
+                errors[k] = qErrors[k] / 65536.0f;
+
+                fpi.fIn = errors[k];
+                tPI_calc(&fpi);
+                qpi.qIn = qErrors[k];
+                tPIQ_calc(&qpi);
+
+                double dev = fabs(fpi.fOut - qpi.qOut / 16777216.0);
+                if (dev > max_dev)
+                    max_dev = dev;
+
+                hash = (hash ^ (uint32_t)qpi.qOut) * 16777619u;
+            }
+
+            printf("  seq %u: max |out deviation| = %.3e\n", seq, max_dev);
+            if (max_dev > worst)
+                worst = max_dev;
+        }
+
+        t0 = now_ns();
+        for (r = 0; r < TIMING_ROUNDS; r++)
+            for (k = 0; k < STEPS; k++) {
+                fpi.fIn = errors[k];
+                tPI_calc(&fpi);
+                fsink += fpi.fOut;
+            }
+        t_float = now_ns() - t0;
+
+        t0 = now_ns();
+        for (r = 0; r < TIMING_ROUNDS; r++)
+            for (k = 0; k < STEPS; k++) {
+                qpi.qIn = qErrors[k];
+                tPIQ_calc(&qpi);
+                qsink += qpi.qOut;
+            }
+        t_fixed = now_ns() - t0;
+
+        printf("  tPI_calc  : %6.2f ns/call\n", t_float / ((double)TIMING_ROUNDS * STEPS));
+        printf("  tPIQ_calc : %6.2f ns/call\n", t_fixed / ((double)TIMING_ROUNDS * STEPS));
+    }
+
+    // Feedforward, kept out of the hash: a 50V..30V sawtooth input against
+    // a 75V output, float and fixed point have to agree on both the
+    // feedforward duty and the controller output
+    for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        tPI fpi = { .fKp = cases[c].fKp, .fKi = cases[c].fKi, .fDtSec = cases[c].fDtSec,
+                    .fUpOutLim = cases[c].fUpOutLim, .fLowOutLim = cases[c].fLowOutLim };
+        tPIQ qpi = { .qKp = PI_Q24(cases[c].fKp), .qKi = PI_Q24(cases[c].fKi),
+                     .qDtSec = PI_Q24(cases[c].fDtSec), .qUpOutLim = PI_Q24(cases[c].fUpOutLim),
+                     .qLowOutLim = PI_Q24(cases[c].fLowOutLim) };
+        double max_dev = 0, max_ff_dev = 0;
+
+        tPI_rst(&fpi);
+        tPIQ_rst(&qpi);
+
+        for (k = 0; k < STEPS; k++) {
+            int32_t vin_mv = 50000 - (int32_t)(k % 4000) * 5;
+            double dev;
+
+            qpi.qIn = PI_Q16(error_at(2, k));
+            qpi.qFf = tPIQ_boost_ff(vin_mv, 75000);
+            tPIQ_calc(&qpi);
+            fpi.fIn = qpi.qIn / 65536.0f;
+            fpi.fFf = tPI_boost_ff(vin_mv / 1000.0f, 75.0f);
+            tPI_calc(&fpi);
+
+            dev = fabs(fpi.fFf - qpi.qFf / 16777216.0);
+            if (dev > max_ff_dev)
+                max_ff_dev = dev;
+            dev = fabs(fpi.fOut - qpi.qOut / 16777216.0);
+            if (dev > max_dev)
+                max_dev = dev;
+        }
+
+        printf("%s, feedforward: max |ff deviation| = %.3e, max |out deviation| = %.3e\n",
+               cases[c].name, max_ff_dev, max_dev);
+        if (max_ff_dev > worst)
+            worst = max_ff_dev;
+        if (max_dev > worst)
+            worst = max_dev;
+    }
+
+    printf("worst deviation : %.3e (duty fraction)\n", worst);
+    printf("fixed output hash: 0x%08X (golden 0x%08X) %s\n", hash, GOLDEN_HASH,
+           hash == GOLDEN_HASH ? "PASS" : "FAIL");
+
+    // One TA1CCR1 count at TA1CCR0 = 19 is 0.05 duty
+    return (hash == GOLDEN_HASH && worst < 0.01) ? 0 : 1;
+}
@@ -0,0 +1,395 @@
+// PV array + averaged boost converter plant, used to run the control code
+// in closed loop on a PC (see SIM_LOOP.c).
+
+#include <math.h>
+#include "PV_SIM.h"
+
+#define PV_TREF     298.15      // STC cell temperature (K)
+#define PV_GREF     1000.0      // STC irradiance (W/m^2)
+#define PV_EG       1.12        // Silicon band gap (eV)
+#define PV_Q_K      11604.52    // q / k (K/V)
+
+// Board sensor chain, same constants as SENSOR.c and the original firmware
+#define SIM_VREF    2.5
+#define SIM_V_GAIN  772.0
+#define SIM_V_OFS   1.286
+#define SIM_I_GAIN  0.05
+#define SIM_I_OFS   1.653
+
+void pv_init(tPV* ptPV, uint16_t u16Nser, uint16_t u16Npar)
+{
+    double vt = PV_TREF / PV_Q_K;
+    double a;
+
+    ptPV->u16Nser = u16Nser;
+    ptPV->u16Npar = u16Npar;
+
+    // Ideality factor that puts the STC open circuit voltage at PV_MODULE_VOC
+    a = PV_MODULE_VOC / log((PV_MODULE_IL - PV_MODULE_VOC / PV_MODULE_RSH) / PV_MODULE_I0 + 1.0);
+    ptPV->dN = a / (PV_MODULE_NCELL * vt);
+
+    ptPV->dVdLast = 0.0;
+    ptPV->tShade.u8Count = 0;
+    ptPV->dIlast = 0.0;
+    pv_set_conditions(ptPV, PV_GREF, 25.0);
+}
+
+void pv_set_shade(tPV* ptPV, const tPV_SHADE* ptShade)
+{
+    ptPV->tShade = *ptShade;
+    if (ptPV->tShade.u8Count > PV_GROUP_MAX)
+        ptPV->tShade.u8Count = PV_GROUP_MAX;
+    ptPV->dIlast = 0.0;
+}
+
+void pv_set_conditions(tPV* ptPV, double dG, double dT)
+{
+    double tk = dT + 273.15;
+
+    ptPV->dG = dG;
+    ptPV->dT = dT;
+
+    ptPV->dIL = (PV_MODULE_IL + PV_MODULE_ISC * PV_MODULE_KISC / 100.0 * (dT - 25.0)) * dG / PV_GREF;
+    if (ptPV->dIL < 0.0) ptPV->dIL = 0.0;
+
+    ptPV->dI0 = PV_MODULE_I0 * pow(tk / PV_TREF, 3.0)
+              * exp(PV_EG * PV_Q_K / ptPV->dN * (1.0 / PV_TREF - 1.0 / tk));
+    ptPV->dA = PV_MODULE_NCELL * ptPV->dN * tk / PV_Q_K;
+}
+
+// Terminal voltage of one module carrying dI with light current dIL, the
+// bypass diode clamps it at -PV_BYPASS_VF. Newton on the diode voltage from
+// the Rsh-free solution, which is an upper bound, so it converges from the
+// right without overshoot.
+static double module_voltage(const tPV* ptPV, double dIL, double dI, double *pdVdI)
+{
+    double vd, gd, v;
+    uint8_t i;
+
+    if (dIL - dI > 0.0)
+    {
+        vd = ptPV->dA * log((dIL - dI) / ptPV->dI0 + 1.0);
+
+        for (i = 0; i < 30; i++)
+        {
+            double e = ptPV->dI0 * exp(vd / ptPV->dA);
+            double h = dIL - (e - ptPV->dI0) - vd / PV_MODULE_RSH - dI;
+            double step;
+
+            gd = e / ptPV->dA + 1.0 / PV_MODULE_RSH;
+            step = h / gd;
+            vd += step;
+
+            if (fabs(step) < 1e-12 * (1.0 + fabs(vd)))
+                break;
+        }
+    }
+    else
+    {
+        // Reverse biased cells, the diode term is negligible
+        vd = PV_MODULE_RSH * (dIL + ptPV->dI0 - dI);
+    }
+
+    gd = ptPV->dI0 * exp(vd / ptPV->dA) / ptPV->dA + 1.0 / PV_MODULE_RSH;
+    v = vd - dI * PV_MODULE_RS;
+    *pdVdI = -1.0 / gd - PV_MODULE_RS;
+
+    if (v < -PV_BYPASS_VF)
+    {
+        v = -PV_BYPASS_VF;
+        *pdVdI = -0.01;
+    }
+
+    return v;
+}
+
+// String voltage at module current dI, summed over the shading groups
+static double string_voltage(const tPV* ptPV, double dI, double *pdVdI)
+{
+    double v = 0.0, dvdi = 0.0, slope;
+    uint16_t rest = ptPV->u16Nser;
+    uint8_t g;
+
+    for (g = 0; g < ptPV->tShade.u8Count; g++)
+    {
+        uint16_t n = ptPV->tShade.au16Modules[g] < rest ? ptPV->tShade.au16Modules[g] : rest;
+
+        v += n * module_voltage(ptPV, ptPV->dIL * ptPV->tShade.adFactor[g], dI, &slope);
+        dvdi += n * slope;
+        rest -= n;
+    }
+
+    if (rest)
+    {
+        v += rest * module_voltage(ptPV, ptPV->dIL, dI, &slope);
+        dvdi += rest * slope;
+    }
+
+    *pdVdI = dvdi;
+    return v;
+}
+
+// Shaded array: string voltage is decreasing in the current, so solve for
+// the current with Newton kept inside a bisection bracket
+static double shaded_current(tPV* ptPV, double dV, double *pdDIdV)
+{
+    double lo = -50.0, hi = ptPV->dIL + 1.0;
+    double im = ptPV->dIlast, dvdi = -1.0;
+    uint8_t i;
+
+    if (im <= lo || im >= hi)
+        im = 0.5 * (lo + hi);
+
+    for (i = 0; i < 100; i++)
+    {
+        double f = string_voltage(ptPV, im, &dvdi) - dV;
+        double next;
+
+        if (f > 0.0) lo = im; else hi = im;
+
+        next = im - f / dvdi;
+        if (!(next > lo && next < hi))
+            next = 0.5 * (lo + hi);
+
+        if (fabs(next - im) < 1e-10)
+        {
+            im = next;
+            break;
+        }
+        im = next;
+    }
+    ptPV->dIlast = im;
+
+    if (pdDIdV)
+        *pdDIdV = ptPV->u16Npar / dvdi;
+
+    return im * ptPV->u16Npar;
+}
+
+// Array current at terminal voltage dV. Newton iteration on the diode
+// voltage Vd = Vm + Im*Rs, where the residual is increasing and convex.
+// *pdDIdV (optional) gets the small signal slope dI/dV of the array.
+double pv_current(tPV* ptPV, double dV, double *pdDIdV)
+{
+    double vm = dV / ptPV->u16Nser;
+    double vd = ptPV->dVdLast;
+    double e = 0.0, gd = 0.0, im;
+    uint8_t i;
+
+    if (ptPV->tShade.u8Count)
+        return shaded_current(ptPV, dV, pdDIdV);
+
+    for (i = 0; i < 50; i++)
+    {
+        double f, df, step;
+
+        e = ptPV->dI0 * exp(vd / ptPV->dA);
+        gd = e / ptPV->dA + 1.0 / PV_MODULE_RSH;
+        f = vd - vm - PV_MODULE_RS * (ptPV->dIL - (e - ptPV->dI0) - vd / PV_MODULE_RSH);
+        df = 1.0 + PV_MODULE_RS * gd;
+
+        step = f / df;
+        // Limit upward steps so exp() cannot overflow after an overshoot
+        if (step < -2.0 * ptPV->dA) step = -2.0 * ptPV->dA;
+        vd -= step;
+
+        if (fabs(step) < 1e-12 * (1.0 + fabs(vd)))
+            break;
+    }
+    ptPV->dVdLast = vd;
+
+    im = ptPV->dIL - (e - ptPV->dI0) - vd / PV_MODULE_RSH;
+
+    if (pdDIdV)
+        *pdDIdV = -gd / (1.0 + PV_MODULE_RS * gd) * ptPV->u16Npar / ptPV->u16Nser;
+
+    return im * ptPV->u16Npar;
+}
+
+// Maximum power of the array at the present conditions. Coarse scan first,
+// so that multi-peak curves still find the global maximum, then golden
+// section refinement around the best scan point.
+double pv_mpp(tPV* ptPV, double *pdVmpp)
+{
+    const double gr = 0.6180339887498949;
+    double vmax = ptPV->u16Nser * PV_MODULE_VOC * 1.3;
+    double dv = vmax / 200.0;
+    double vbest = 0.0, pbest = 0.0;
+    double lo, hi, x1, x2, p1, p2;
+    double vd_saved = ptPV->dVdLast;
+    double i_saved = ptPV->dIlast;
+    uint16_t k;
+
+    for (k = 1; k <= 200; k++)
+    {
+        double v = dv * k;
+        double p = v * pv_current(ptPV, v, 0);
+        if (p > pbest) { pbest = p; vbest = v; }
+    }
+
+    lo = vbest - dv; if (lo < 0.0) lo = 0.0;
+    hi = vbest + dv;
+    x1 = hi - gr * (hi - lo);
+    x2 = lo + gr * (hi - lo);
+    p1 = x1 * pv_current(ptPV, x1, 0);
+    p2 = x2 * pv_current(ptPV, x2, 0);
+
+    for (k = 0; k < 60 && hi - lo > 1e-6; k++)
+    {
+        if (p1 > p2)
+        {
+            hi = x2; x2 = x1; p2 = p1;
+            x1 = hi - gr * (hi - lo);
+            p1 = x1 * pv_current(ptPV, x1, 0);
+        }
+        else
+        {
+            lo = x1; x1 = x2; p1 = p2;
+            x2 = lo + gr * (hi - lo);
+            p2 = x2 * pv_current(ptPV, x2, 0);
+        }
+    }
+
+    ptPV->dVdLast = vd_saved;
+    ptPV->dIlast = i_saved;
+
+    if (p1 > pbest) { pbest = p1; vbest = x1; }
+    if (p2 > pbest) { pbest = p2; vbest = x2; }
+    if (pdVmpp) *pdVmpp = vbest;
+    return pbest;
+}
+
+// Starts from rest, capacitors discharged and no inductor current
+void boost_init(tBOOST* ptBoost)
+{
+    ptBoost->dVin = 0.0;
+    ptBoost->dIind = 0.0;
+    ptBoost->dVout = 0.0;
+    ptBoost->dIin = 0.0;
+}
+
+// One backward Euler step of the averaged boost. The source is linearised
+// around the present input voltage, which keeps the step a small linear
+// solve and stable for any dH.
+//
+//   Cin  dVin/dt  = Is(Vin) - IL
+//   L    dIL/dt   = Vin - RL*IL - (1-D)*Vout
+//   Cout dVout/dt = (1-D)*IL - Vout/R
+void boost_step(tBOOST* ptBoost, tPV* ptPV, double dDuty, double dH)
+{
+    double dp = 1.0 - dDuty;
+    double is, g;
+    double k1, b0, b1, k3, a0, a1, i, v, u;
+
+    if (ptPV)
+    {
+        is = pv_current(ptPV, ptBoost->dVin, &g);
+    }
+    else
+    {
+        is = (ptBoost->dVdc - ptBoost->dVin) / ptBoost->dRdc;
+        g = -1.0 / ptBoost->dRdc;
+    }
+
+    // Vin = b0 - b1*IL
+    k1 = ptBoost->dCin / dH - g;
+    b0 = (ptBoost->dCin / dH * ptBoost->dVin + is - g * ptBoost->dVin) / k1;
+    b1 = 1.0 / k1;
+
+    // Vout = a0 + a1*IL
+    k3 = ptBoost->dCout / dH + 1.0 / ptBoost->dR;
+    a0 = ptBoost->dCout / dH * ptBoost->dVout / k3;
+    a1 = dp / k3;
+
+    i = (ptBoost->dL / dH * ptBoost->dIind + b0 - dp * a0)
+      / (ptBoost->dL / dH + ptBoost->dRL + b1 + dp * a1);
+
+    // Diode blocks reverse inductor current
+    if (i < 0.0) i = 0.0;
+
+    v = b0 - b1 * i;
+    u = a0 + a1 * i;
+
+    ptBoost->dIin = is + g * (v - ptBoost->dVin);
+    ptBoost->dVin = v;
+    ptBoost->dIind = i;
+    ptBoost->dVout = u;
+}
+
+// Advances the plant by dTime at constant duty. Once the states stop moving
+// the remaining steps would be identical, so they are skipped.
+void boost_run(tBOOST* ptBoost, tPV* ptPV, double dDuty, double dTime, double dH)
+{
+    double t;
+
+    for (t = 0.0; t < dTime - 0.5 * dH; t += dH)
+    {
+        double v = ptBoost->dVin, i = ptBoost->dIind, u = ptBoost->dVout;
+
+        boost_step(ptBoost, ptPV, dDuty, dH);
+
+        if (fabs(ptBoost->dVin - v) < 1e-9 * (1.0 + fabs(v)) &&
+            fabs(ptBoost->dIind - i) < 1e-9 * (1.0 + fabs(i)) &&
+            fabs(ptBoost->dVout - u) < 1e-9 * (1.0 + fabs(u)))
+            break;
+    }
+}
+
+// Steady state PV voltage at a duty cycle: the PV curve crossing the load
+// line Vin = Iin * (RL + (1-D)^2 * R), found by bisection
+double boost_steady_vin(const tBOOST* ptBoost, tPV* ptPV, double dDuty)
+{
+    double rin = ptBoost->dRL + (1.0 - dDuty) * (1.0 - dDuty) * ptBoost->dR;
+    double lo = 0.0, hi = ptPV->u16Nser * PV_MODULE_VOC * 1.3;
+    uint8_t i;
+
+    for (i = 0; i < 60; i++)
+    {
+        double v = 0.5 * (lo + hi);
+
+        if (v - pv_current(ptPV, v, 0) * rin > 0.0)
+            hi = v;
+        else
+            lo = v;
+    }
+
+    return 0.5 * (lo + hi);
+}
+
+// xorshift32 + Box-Muller, the state is owned by the caller so parallel
+// runs do not share it
+static double sim_gauss(uint32_t *pu32Rng)
+{
+    double u1, u2;
+    uint32_t x = *pu32Rng;
+
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    u1 = (x + 1.0) / 4294967297.0;
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    u2 = x / 4294967296.0;
+    *pu32Rng = x;
+
+    return sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+}
+
+static uint16_t sim_adc(double dVadc, double dNoiseLsb, uint32_t *pu32Rng)
+{
+    double code = dVadc / SIM_VREF * 4096.0;
+
+    if (dNoiseLsb > 0.0)
+        code += dNoiseLsb * sim_gauss(pu32Rng);
+
+    if (code < 0.0) return 0;
+    if (code > 4095.0) return 4095;
+    return (uint16_t)code;
+}
+
+uint16_t sim_adc_voltage(double dV, double dNoiseLsb, uint32_t *pu32Rng)
+{
+    return sim_adc(dV / SIM_V_GAIN + SIM_V_OFS, dNoiseLsb, pu32Rng);
+}
+
+uint16_t sim_adc_current(double dI, double dNoiseLsb, uint32_t *pu32Rng)
+{
+    return sim_adc(dI * SIM_I_GAIN + SIM_I_OFS, dNoiseLsb, pu32Rng);
+}
@@ -0,0 +1,80 @@
+#ifndef PV_SIM_H
+#define PV_SIM_H
+
+#include <stdint.h>
+
+// Host-side plant model: PV array (single diode) feeding an averaged boost
+// converter, plus the ADC front end of the MSP430 board. PC only.
+
+// PV module parameters from the "PV Array1" block of MPPT.slx
+#define PV_MODULE_NCELL 60
+#define PV_MODULE_VOC   36.3
+#define PV_MODULE_ISC   7.84
+#define PV_MODULE_IL    7.8654
+#define PV_MODULE_I0    2.9273e-10
+#define PV_MODULE_RS    0.39381
+#define PV_MODULE_RSH   313.0553
+#define PV_MODULE_KISC  0.102       // Isc temperature coefficient (%/deg C)
+#define PV_BYPASS_VF    0.5         // Bypass diode forward voltage per module
+
+#define PV_GROUP_MAX    4
+
+// Partial shading: groups of modules in every string that see a fraction of
+// the irradiance. Modules not in a group get the full irradiance. Each module
+// has a bypass diode, so a shaded string gives a multi-peak P-V curve.
+typedef struct {
+    uint8_t u8Count;
+    uint16_t au16Modules[PV_GROUP_MAX];
+    double adFactor[PV_GROUP_MAX];
+} tPV_SHADE;
+
+// PV array, single diode model per module
+typedef struct {
+    uint16_t u16Nser;       // Modules in series per string
+    uint16_t u16Npar;       // Parallel strings
+    double dG;              // Irradiance (W/m^2)
+    double dT;              // Cell temperature (deg C)
+
+    double dIL;             // Light current per module at dG, dT
+    double dI0;             // Diode saturation current per module at dT
+    double dA;              // Ncell * n * Vt at dT
+    double dN;              // Diode ideality factor, fitted to PV_MODULE_VOC
+    double dVdLast;         // Last diode voltage, Newton start point
+
+    tPV_SHADE tShade;       // No groups: uniform irradiance
+    double dIlast;          // Last string current, shaded solve start point
+} tPV;
+
+// Averaged boost converter (CCM, inductor current clamped at zero)
+typedef struct {
+    double dL;              // Inductance (H)
+    double dRL;             // Inductor series resistance (ohm)
+    double dCin;            // PV side capacitor (F)
+    double dCout;           // Output capacitor (F)
+    double dR;              // Load resistance (ohm)
+    double dVdc;            // DC source voltage when no PV array is used (V)
+    double dRdc;            // DC source internal resistance (ohm)
+
+    double dVin;            // State: input (PV) voltage
+    double dIind;           // State: inductor current
+    double dVout;           // State: output voltage
+    double dIin;            // Source current at the last step
+} tBOOST;
+
+void pv_init(tPV* ptPV, uint16_t u16Nser, uint16_t u16Npar);
+void pv_set_conditions(tPV* ptPV, double dG, double dT);
+void pv_set_shade(tPV* ptPV, const tPV_SHADE* ptShade);
+double pv_current(tPV* ptPV, double dV, double *pdDIdV);
+double pv_mpp(tPV* ptPV, double *pdVmpp);
+
+void boost_init(tBOOST* ptBoost);
+void boost_step(tBOOST* ptBoost, tPV* ptPV, double dDuty, double dH);
+void boost_run(tBOOST* ptBoost, tPV* ptPV, double dDuty, double dTime, double dH);
+double boost_steady_vin(const tBOOST* ptBoost, tPV* ptPV, double dDuty);
+
+// Sensor + ADC12 front end, returns the code the firmware would read.
+// Noise is gaussian with dNoiseLsb standard deviation, drawn from *pu32Rng.
+uint16_t sim_adc_voltage(double dV, double dNoiseLsb, uint32_t *pu32Rng);
+uint16_t sim_adc_current(double dI, double dNoiseLsb, uint32_t *pu32Rng);
+
+#endif
@@ -0,0 +1,139 @@
+// Tracking efficiency on irradiance ramps (EN 50530 style up/down ramps
+// and eclipse exits) of P&O and the drift-free dP-P&O in mppt_algorithm,
+// closed loop against PV_SIM with the MPPT.c timing. The ramps start at
+// 600 W/m^2, below that the MPP of the simulated array leaves the duty
+// window. On a ramp P&O takes the irradiance change for the effect of
+// its own step, dP-P&O has to collect at least as much energy on every
+// ramp. At a constant irradiance IncCond holds the MPP instead of stepping
+// round it, its ripple loss has to stay below that of P&O.
+//
+// Build: gcc -O2 -o ramp_bench RAMP_BENCH.c SIM_LOOP.c PV_SIM.c MPPT_CTRL.c PI.c ADC_FILTER.c SENSOR.c AUTOTUNE.c MPC.c -lm
+// Returns nonzero if any ramp fails.
+
+#include <stdio.h>
+#include "SIM_LOOP.h"
+
+typedef struct {
+    const char *pcName;
+    double dLow;                // W/m^2
+    double dHigh;
+    double dSlope;              // W/m^2 per s, both ways
+    uint8_t u8UpOnly;           // Eclipse exit: one ramp up, then held
+} tRAMP;
+
+static const tRAMP ramps[] = {
+    { "600 <-> 1000, 2/s",      600.0, 1000.0,   2.0, 0 },
+    { "600 <-> 1000, 5/s",      600.0, 1000.0,   5.0, 0 },
+    { "600 <-> 1000, 10/s",     600.0, 1000.0,  10.0, 0 },
+    { "600 <-> 1000, 20/s",     600.0, 1000.0,  20.0, 0 },
+    { "600 <-> 1000, 50/s",     600.0, 1000.0,  50.0, 0 },
+    { "eclipse exit, 10s",      600.0, 1000.0,  40.0, 1 },
+    { "eclipse exit, 40s",      600.0, 1000.0,  10.0, 1 },
+};
+#define NRAMPS (sizeof(ramps) / sizeof(ramps[0]))
+
+#define RAMP_START 30.0         // Settled at dLow before the first ramp (s)
+#define RAMP_HOLD 10.0          // At each end of a ramp (s)
+
+static const double steady[] = { 600.0, 800.0, 1000.0 };   // W/m^2
+#define NSTEADY (sizeof(steady) / sizeof(steady[0]))
+#define STEADY_FROM 60.0        // Ripple loss measured from here, well after the start (s)
+#define STEADY_TO 180.0
+
+static void run(const tRAMP* ptRamp, uint8_t u8Mode, tSIM_RESULT* ptResult)
+{
+    tSIM_CFG cfg;
+    double t = RAMP_START, len = (ptRamp->dHigh - ptRamp->dLow) / ptRamp->dSlope;
+    tSIM_PROFILE *g = &cfg.tIrradiance;
+
+    sim_default_mppt(&cfg);
+    cfg.tMpptSet.u8Mode = u8Mode;
+
+    // Low, ramp up, hold, ramp down, hold
+    g->u8Count = 0;
+    g->adTime[g->u8Count] = 0.0;            g->adValue[g->u8Count++] = ptRamp->dLow;
+    g->adTime[g->u8Count] = t;              g->adValue[g->u8Count++] = ptRamp->dLow;
+    t += len;
+    g->adTime[g->u8Count] = t;              g->adValue[g->u8Count++] = ptRamp->dHigh;
+    t += RAMP_HOLD;
+    if (!ptRamp->u8UpOnly)
+    {
+        g->adTime[g->u8Count] = t;          g->adValue[g->u8Count++] = ptRamp->dHigh;
+        t += len;
+        g->adTime[g->u8Count] = t;          g->adValue[g->u8Count++] = ptRamp->dLow;
+        t += RAMP_HOLD;
+    }
+    cfg.dDuration = t;
+
+    sim_run(&cfg, ptResult, 0);
+}
+
+// Share of the MPP energy lost between STEADY_FROM and STEADY_TO at a
+// constant irradiance: the same seeded run to both times, differenced
+static double ripple_loss(double dIrradiance, uint8_t u8Mode)
+{
+    tSIM_CFG cfg;
+    tSIM_RESULT from, to;
+
+    sim_default_mppt(&cfg);
+    cfg.tMpptSet.u8Mode = u8Mode;
+    cfg.tIrradiance.u8Count = 1;
+    cfg.tIrradiance.adTime[0] = 0.0;
+    cfg.tIrradiance.adValue[0] = dIrradiance;
+
+    cfg.dDuration = STEADY_FROM;
+    sim_run(&cfg, &from, 0);
+    cfg.dDuration = STEADY_TO;
+    sim_run(&cfg, &to, 0);
+
+    return 1.0 - (to.dEnergy - from.dEnergy) / (to.dEnergyMpp - from.dEnergyMpp);
+}
+
+int main(void)
+{
+    tSIM_RESULT po, dppo, inc;
+    int fails = 0, ramp_fails;
+    unsigned c;
+
+    printf("%-24s %10s %10s %10s\n", "ramp", "P&O", "dP-P&O", "IncCond");
+
+    for (c = 0; c < NRAMPS; c++)
+    {
+        run(&ramps[c], MPPT_MODE_PO, &po);
+        run(&ramps[c], MPPT_MODE_DPPO, &dppo);
+        run(&ramps[c], MPPT_MODE_INCCOND, &inc);
+
+        printf("%-24s %9.2f%% %9.2f%% %9.2f%%\n", ramps[c].pcName,
+               po.dEfficiency * 100.0, dppo.dEfficiency * 100.0, inc.dEfficiency * 100.0);
+
+        if (dppo.dEfficiency < po.dEfficiency)
+        {
+            printf("  FAIL: dP-P&O collected less energy than P&O\n");
+            fails++;
+        }
+    }
+
+    printf("%d of %u ramps failed\n", fails, (unsigned)NRAMPS);
+
+    ramp_fails = fails;
+    printf("\n%-24s %10s %10s %10s\n", "ripple loss", "P&O", "dP-P&O", "IncCond");
+    for (c = 0; c < NSTEADY; c++)
+    {
+        char name[32];
+        double l_po = ripple_loss(steady[c], MPPT_MODE_PO);
+        double l_dppo = ripple_loss(steady[c], MPPT_MODE_DPPO);
+        double l_inc = ripple_loss(steady[c], MPPT_MODE_INCCOND);
+
+        snprintf(name, sizeof(name), "%.0f W/m^2, %.0f-%.0fs", steady[c], STEADY_FROM, STEADY_TO);
+        printf("%-24s %9.3f%% %9.3f%% %9.3f%%\n", name, l_po * 100.0, l_dppo * 100.0, l_inc * 100.0);
+
+        if (l_inc >= l_po)
+        {
+            printf("  FAIL: IncCond lost more than P&O at the MPP\n");
+            fails++;
+        }
+    }
+    printf("%d of %u levels failed\n", fails - ramp_fails, (unsigned)NSTEADY);
+
+    return fails ? 1 : 0;
+}
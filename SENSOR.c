@@ -0,0 +1,40 @@
+#include "SENSOR.h"
+
+// Code * scale / 2^bits in 1/256 units. A 16-bit code times the scale
+// overflows 32 bits, the whole LSBs and the fraction are scaled apart.
+static uint32_t sensor_scale(uint16_t adc, uint8_t bits, uint32_t scale)
+{
+    uint32_t whole = (uint32_t)(adc >> bits) * scale;
+    uint32_t frac = ((uint32_t)(adc & ((1U << bits) - 1)) * scale) >> bits;
+
+    return (whole + frac + (1UL << (SENSOR_SCALE_SHIFT - 1))) >> SENSOR_SCALE_SHIFT;
+}
+
+// PV voltage in millivolts, rounded to the nearest mV
+int32_t sensor_voltage_mv(uint16_t adc)
+{
+    return sensor_voltage_mv_ext(adc, 0);
+}
+
+// PV current in milliamps, rounded to the nearest mA
+int32_t sensor_current_ma(uint16_t adc)
+{
+    return sensor_current_ma_ext(adc, 0);
+}
+
+int32_t sensor_voltage_mv_ext(uint16_t adc, uint8_t bits)
+{
+    return (int32_t)sensor_scale(adc, bits, SENSOR_V_SCALE) - SENSOR_V_OFFSET_MV;
+}
+
+int32_t sensor_current_ma_ext(uint16_t adc, uint8_t bits)
+{
+    return (int32_t)sensor_scale(adc, bits, SENSOR_I_SCALE) - SENSOR_I_OFFSET_MA;
+}
+
+// Power in milliwatts. mV * mA can exceed 32 bits at the top of the
+// sensor range, so the product is taken in 64 bits.
+int32_t sensor_power_mw(int32_t mv, int32_t ma)
+{
+    return (int32_t)(((int64_t)mv * ma) / 1000);
+}
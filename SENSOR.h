@@ -0,0 +1,25 @@
+#ifndef SENSOR_H
+#define SENSOR_H
+
+#include <stdint.h>
+
+// Integer conversion of 12-bit ADC12 readings (Vref = 2.5V) to PV quantities.
+// Equivalent to the float formulas used in the firmware:
+//   voltage = 772 * (adc * 2.5 / 4096 - 1.286)        [V]
+//   current = (adc * 2.5 / 4096 - 1.653) / 0.05       [A]
+
+#define SENSOR_V_SCALE     120625UL   // 2500mV * 772 / 4096, as 120625 / 256
+#define SENSOR_V_OFFSET_MV 992792L    // 772 * 1286mV
+#define SENSOR_I_SCALE     3125UL     // 2500mV * 20mA/mV / 4096, as 3125 / 256
+#define SENSOR_I_OFFSET_MA 33060L     // 1653mV * 20mA/mV
+#define SENSOR_SCALE_SHIFT 8
+
+int32_t sensor_voltage_mv(uint16_t adc);
+int32_t sensor_current_ma(uint16_t adc);
+
+// The same for an oversampled (12 + bits)-bit code, see tDECIM
+int32_t sensor_voltage_mv_ext(uint16_t adc, uint8_t bits);
+int32_t sensor_current_ma_ext(uint16_t adc, uint8_t bits);
+int32_t sensor_power_mw(int32_t mv, int32_t ma);
+
+#endif
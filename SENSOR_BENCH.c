@@ -0,0 +1,101 @@
+// Host equivalence check and benchmark for SENSOR (not for the MSP430).
+// The timings are host-only: the PC has a hardware FPU, so float can come
+// out faster than fixed point here. They say nothing about MSP430 cycles,
+// where float goes through the software float library.
+// Build: gcc -O2 -o sensor_bench SENSOR_BENCH.c SENSOR.c
+// Usage: ./sensor_bench
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "SENSOR.h"
+
+#define ADC_CODES 4096
+#define ROUNDS 2000
+
+// Float formulas from the MPPT.c ADC12 ISR
+static float float_voltage(uint16_t avg_adc)
+{
+    float Vout = (avg_adc * 2.5f) / 4096.0f;
+    return 772.0f * (Vout - 1.286f);
+}
+
+static float float_current(uint16_t avg_adc)
+{
+    float sensor2 = (avg_adc * 2.5f) / 4096.0f;
+    return (sensor2 - 1.653f) / 0.05f;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static long round_milli(double v)
+{
+    return (long)(v * 1000.0 + (v >= 0 ? 0.5 : -0.5));
+}
+
+int main(void)
+{
+    uint16_t adc;
+    long err, max_v_err = 0, max_i_err = 0, max_p_err = 0;
+    uint16_t worst_v = 0, worst_i = 0;
+    uint32_t r;
+    volatile float fsink = 0;
+    volatile int32_t isink = 0;
+    double t0, t_float, t_fixed;
+
+    // Every 12-bit code, against the float formulas rounded to 1mV / 1mA
+    for (adc = 0; adc < ADC_CODES; adc++) {
+        err = labs(sensor_voltage_mv(adc) - round_milli(float_voltage(adc)));
+        if (err > max_v_err) {
+            max_v_err = err;
+            worst_v = adc;
+        }
+
+        err = labs(sensor_current_ma(adc) - round_milli(float_current(adc)));
+        if (err > max_i_err) {
+            max_i_err = err;
+            worst_i = adc;
+        }
+    }
+
+    // Power over a V/I grid, against the float product (in W, 1mW = 1 LSB)
+    for (adc = 0; adc < ADC_CODES; adc += 7) {
+        uint16_t adc_i;
+        for (adc_i = 0; adc_i < ADC_CODES; adc_i += 13) {
+            int32_t mv = sensor_voltage_mv(adc);
+            int32_t ma = sensor_current_ma(adc_i);
+            double p = ((double)mv / 1000.0) * ((double)ma / 1000.0);
+
+            err = labs(sensor_power_mw(mv, ma) - (long)(p * 1000.0));
+            if (err > max_p_err)
+                max_p_err = err;
+        }
+    }
+
+    t0 = now_ns();
+    for (r = 0; r < ROUNDS; r++)
+        for (adc = 0; adc < ADC_CODES; adc++)
+            fsink += float_voltage(adc) * float_current(adc);
+    t_float = now_ns() - t0;
+
+    t0 = now_ns();
+    for (r = 0; r < ROUNDS; r++)
+        for (adc = 0; adc < ADC_CODES; adc++)
+            isink += sensor_power_mw(sensor_voltage_mv(adc), sensor_current_ma(adc));
+    t_fixed = now_ns() - t0;
+
+    printf("voltage: max error %ld mV (adc %u)\n", max_v_err, worst_v);
+    printf("current: max error %ld mA (adc %u)\n", max_i_err, worst_i);
+    printf("power  : max error %ld mW\n", max_p_err);
+    printf("host float V,I,P : %6.2f ns/sample\n", t_float / ((double)ROUNDS * ADC_CODES));
+    printf("host fixed V,I,P : %6.2f ns/sample\n", t_fixed / ((double)ROUNDS * ADC_CODES));
+    printf("(host-only timings on the PC FPU, not MSP430 cycles: there float runs in the software float library)\n");
+
+    return (max_v_err > 1 || max_i_err > 1 || max_p_err > 1) ? 1 : 0;
+}
@@ -0,0 +1,513 @@
+// Closed loop simulation: the plant is advanced by dSamplePeriod between
+// firmware steps. In SIM_MODE_MPPT a step is one MPPT loop: u16AdcBlocks
+// DMA blocks of u16AdcBlock single A10/A7 conversions (one pair with
+// u16AdcBlock 0), taken from the plant state at the start of the step,
+// which mppt_sample_block() oversamples and decimates (tDECIM) into filter
+// samples before mppt_algorithm(). The PI modes run one control ISR per
+// step on one conversion of each sensed signal, and turn the duty into a
+// compare count with tPI_counts()/tPIQ_counts() like the firmware does.
+
+#include <math.h>
+#include <string.h>
+#include "SIM_LOOP.h"
+#include "ADC_FILTER.h"
+#include "SENSOR.h"
+
+// MPPT.c hardware. The Simulink array (40 strings) is cut down to 2 strings
+// so the current stays inside the 16.9 A range of the current sensor, and
+// the load is picked to put the MPP inside the 10%..50% duty window.
+void sim_default_mppt(tSIM_CFG* ptCfg)
+{
+    memset(ptCfg, 0, sizeof(*ptCfg));
+
+    ptCfg->u8Mode = SIM_MODE_MPPT;
+    ptCfg->dDuration = 300.0;
+    ptCfg->dSamplePeriod = 0.128;         // MPPT step, 2 DMA blocks of 32 pairs at 500 pairs/s
+    ptCfg->dH = 1e-4;
+    ptCfg->dNoiseLsb = 1.0;
+    ptCfg->u32Seed = 1;
+
+    ptCfg->u16Nser = 10;
+    ptCfg->u16Npar = 2;
+    ptCfg->tIrradiance.u8Count = 1;
+    ptCfg->tIrradiance.adValue[0] = 1000.0;
+    ptCfg->tTemperature.u8Count = 1;
+    ptCfg->tTemperature.adValue[0] = 25.0;
+
+    ptCfg->tBoost.dL = 45e-6;
+    ptCfg->tBoost.dRL = 0.01;
+    ptCfg->tBoost.dCin = 244e-6;
+    ptCfg->tBoost.dCout = 100e-6;
+    ptCfg->tBoost.dR = 40.0;
+    ptCfg->u16PwmCcr0 = 999;
+
+    ptCfg->tMpptSet.u16DutyStep = 10;
+    ptCfg->tMpptSet.u16MinDuty = 100;
+    ptCfg->tMpptSet.u16MaxDuty = 500;
+    ptCfg->tMpptSet.u8Delay = 15;
+    ptCfg->tMpptSet.u16SettleTol = 5;
+    ptCfg->tMpptSet.u8SettleSteps = 3;
+    ptCfg->tMpptSet.u16FocvK = 850;
+    ptCfg->tMpptSet.u16PwmPeriod = 1000;
+    ptCfg->tMpptSet.u16FilterSize = 4;
+    ptCfg->tMpptSet.u8VoltRobust = FILTER_HAMPEL;
+    ptCfg->tMpptSet.u8CurrRobust = FILTER_HAMPEL;
+    ptCfg->tMpptSet.u8RobustSize = 3;
+    ptCfg->tMpptSet.u8Estimator = MPPT_EST_BOXCAR;
+    ptCfg->tMpptSet.u32KalmanQ = KALMAN_Q24(1e-6);
+    ptCfg->tMpptSet.u32KalmanR = KALMAN_Q24(1.0 / 32);   // 1 LSB conversion noise over a block
+    ptCfg->tMpptSet.u8Mode = MPPT_MODE_PO;
+    ptCfg->tMpptSet.u16IncTol = 20;
+    ptCfg->tMpptSet.u16StepScale = 0;
+    ptCfg->tMpptSet.u16MinStep = 5;
+    ptCfg->tMpptSet.u16MaxStep = 50;
+    ptCfg->tMpptSet.u8Particles = 0;
+    ptCfg->tMpptSet.u8SearchIter = 10;
+    ptCfg->tMpptSet.u16SearchFilter = 8;
+    ptCfg->tMpptSet.u16SearchTrigger = 200;
+    ptCfg->u16AdcBlock = 32;              // HAL_ADC_BLOCK
+    ptCfg->u16AdcBlocks = 2;              // BLOCKS_PER_STEP
+}
+
+// MPPT_PI.c: the MPPT.c array and converter with a 1kHz PV voltage loop.
+// The MPPT keeps its duty window and step, mapped to a 350V..190V reference.
+void sim_default_cascade(tSIM_CFG* ptCfg)
+{
+    sim_default_mppt(ptCfg);
+
+    ptCfg->u8Mode = SIM_MODE_CASCADE;
+    ptCfg->u8Fixed = 1;
+    ptCfg->dSamplePeriod = 0.001;         // Control interrupt, one A10/A7 pair per PWM period
+    ptCfg->u16AdcBlock = 64;              // OUTER_BLOCK
+    ptCfg->u16AdcBlocks = 2;              // BLOCKS_PER_STEP, 128ms MPPT step
+
+    ptCfg->tMpptSet.u16FocvK = 0;         // The inner PI sets the duty
+    ptCfg->tMpptSet.i32VrefMax = 350000;
+    ptCfg->tMpptSet.u16VrefStep = 400;
+
+    ptCfg->tPiSet.fKp = 0.001f;
+    ptCfg->tPiSet.fKi = 25.5f;
+    ptCfg->tPiSet.fUpOutLim = 0.5f;       // MPPT duty window
+    ptCfg->tPiSet.fLowOutLim = 0.1f;
+    ptCfg->u16PiFilterSize = 1;
+}
+
+// CLOSE_LOOP_BOOST_PI.c hardware, L/C/R from Boost_Closed_Loop.slx with a
+// 50V source so the 75V reference is reachable inside the duty clamp
+void sim_default_pi(tSIM_CFG* ptCfg)
+{
+    memset(ptCfg, 0, sizeof(*ptCfg));
+
+    ptCfg->u8Mode = SIM_MODE_PI;
+    ptCfg->u8Fixed = 1;
+    ptCfg->dDuration = 20.0;
+    ptCfg->dSamplePeriod = 0.001;         // Control interrupt, 50kHz PWM / CONTROL_DECIM
+    ptCfg->dH = 1e-4;
+    ptCfg->dNoiseLsb = 1.0;
+    ptCfg->u32Seed = 1;
+
+    ptCfg->tBoost.dL = 2e-3;
+    ptCfg->tBoost.dRL = 0.01;
+    ptCfg->tBoost.dCin = 1e-6;
+    ptCfg->tBoost.dCout = 15e-6;
+    ptCfg->tBoost.dR = 73.0;
+    ptCfg->tBoost.dVdc = 50.0;
+    ptCfg->tBoost.dRdc = 0.05;
+    ptCfg->u16PwmCcr0 = 19;
+
+    ptCfg->tPiSet.fKp = 0.01f;
+    ptCfg->tPiSet.fKi = 10.5f;
+    ptCfg->tPiSet.fDtSec = 0.001f;        // Replaced by dSamplePeriod
+    ptCfg->tPiSet.fUpOutLim = 0.4f;
+    ptCfg->tPiSet.fLowOutLim = 0.0f;
+    ptCfg->u16PiFilterSize = 10;
+    ptCfg->fVref = 75.0f;
+    ptCfg->fDutyMax = 0.5f;
+
+    ptCfg->tTuneSet.qAmp = PI_Q24(0.1f);  // Two TA1CCR1 counts
+    ptCfg->tTuneSet.i32HystMv = 1000;
+    ptCfg->tTuneSet.u8Cycles = 4;
+    ptCfg->tTuneSet.u16MaxSteps = 5000;
+
+    ptCfg->tMpcSet.i32VinMv = 50000;      // VIN_MV
+    ptCfg->tMpcSet.qGv = MPC_Q8(0.25f);
+    ptCfg->tMpcSet.qGo = MPC_Q16(0.02f);
+    ptCfg->tMpcSet.qWi = MPC_Q8(1.0f);
+    ptCfg->tMpcSet.i32WduMv = 300;
+    ptCfg->tMpcSet.u16MaxCount = 10;      // fDutyMax
+    ptCfg->tMpcSet.u8Span = 1;
+}
+
+double sim_profile_at(const tSIM_PROFILE* ptProfile, double dTime)
+{
+    uint8_t i;
+
+    if (ptProfile->u8Count == 0)
+        return 0.0;
+    if (dTime <= ptProfile->adTime[0])
+        return ptProfile->adValue[0];
+
+    for (i = 1; i < ptProfile->u8Count; i++)
+    {
+        if (dTime < ptProfile->adTime[i])
+        {
+            double t0 = ptProfile->adTime[i - 1], t1 = ptProfile->adTime[i];
+            double v0 = ptProfile->adValue[i - 1], v1 = ptProfile->adValue[i];
+            return v0 + (v1 - v0) * (dTime - t0) / (t1 - t0);
+        }
+    }
+
+    return ptProfile->adValue[ptProfile->u8Count - 1];
+}
+
+void sim_run(const tSIM_CFG* ptCfg, tSIM_RESULT* ptResult, FILE* ptCsv)
+{
+    tPV pv;
+    tPV* ptPV = 0;
+    tBOOST boost = ptCfg->tBoost;
+    tMPPT mppt = ptCfg->tMpptSet;
+    tPI pi = ptCfg->tPiSet;
+    tPIQ piq;
+    tTUNE tune = ptCfg->tTuneSet;
+    tMPC mpc = ptCfg->tMpcSet;
+    tFILTER filter;
+    uint16_t au16Buf[MPPT_FILTER_MAX];
+    uint16_t u16FilterSize = ptCfg->u16PiFilterSize;
+    uint32_t u32Rng = ptCfg->u32Seed ? ptCfg->u32Seed : 1;
+    uint16_t ccr1;
+    double period = ptCfg->u16PwmCcr0 + 1.0;
+    double g = -1.0, temp = -1.0, pmpp = 0.0;
+    double duty_min = 1.0, duty_max = 0.0;
+    uint8_t shaded = 0;
+    double t = 0.0, above = -1.0, below = -1.0, out5 = -1.0;
+    uint8_t tracking = 0;
+    uint32_t sum_v = 0, sum_i = 0;
+    uint16_t block_v[SIM_ADC_BLOCK_MAX], block_i[SIM_ADC_BLOCK_MAX];
+    uint16_t pairs = 0, blocks = 0;
+    uint32_t k, n = (uint32_t)(ptCfg->dDuration / ptCfg->dSamplePeriod + 0.5);
+
+    memset(ptResult, 0, sizeof(*ptResult));
+    ptResult->dSettleTime = -1.0;
+
+    if (ptCfg->u16Nser)
+    {
+        pv_init(&pv, ptCfg->u16Nser, ptCfg->u16Npar);
+        ptPV = &pv;
+    }
+    boost_init(&boost);
+
+    if (ptCfg->u8Mode == SIM_MODE_MPPT)
+    {
+        // No conversions per filter sample set: one per simulated DMA block,
+        // as OS_SAMPLES in MPPT.c
+        if (mppt.u16OsSamples == 0)
+            mppt.u16OsSamples = ptCfg->u16AdcBlock == 0 ? 1 :
+                                ptCfg->u16AdcBlock < SIM_ADC_BLOCK_MAX ? ptCfg->u16AdcBlock : SIM_ADC_BLOCK_MAX;
+
+        mppt_rst(&mppt);
+        ccr1 = mppt.u16Duty;
+    }
+    else
+    {
+        if (ptCfg->u8Mode == SIM_MODE_CASCADE)
+            mppt_rst(&mppt);
+
+        if (u16FilterSize > MPPT_FILTER_MAX) u16FilterSize = MPPT_FILTER_MAX;
+        tFILTER_init(&filter, au16Buf, u16FilterSize);
+        pi.fDtSec = (float)ptCfg->dSamplePeriod;   // Integrator step from the actual rate
+        tPI_rst(&pi);
+
+        memset(&piq, 0, sizeof(piq));
+        piq.qKp = PI_Q24(pi.fKp);
+        piq.qKi = PI_Q24(pi.fKi);
+        piq.qDtSec = PI_Q24(pi.fDtSec);
+        piq.qUpOutLim = PI_Q24(pi.fUpOutLim);
+        piq.qLowOutLim = PI_Q24(pi.fLowOutLim);
+        tPIQ_rst(&piq);
+        ccr1 = 0;
+        tune.u8State = TUNE_IDLE;
+
+        // Model from the plant unless given, one step per sample period
+        mpc.u16Period = ptCfg->u16PwmCcr0 + 1;
+        if (!mpc.qKl)
+            mpc.qKl = MPC_KL((float)ptCfg->dSamplePeriod, (float)ptCfg->tBoost.dL, mpc.u16Period);
+        if (!mpc.qKc)
+            mpc.qKc = MPC_KC((float)ptCfg->dSamplePeriod, (float)ptCfg->tBoost.dCout, mpc.u16Period);
+        mpc.i32VrefMv = (int32_t)(ptCfg->fVref * 1000.0f);
+        mpc.i32VoutMv = 0;
+        tMPC_rst(&mpc);
+
+        if (ptCfg->u8Mode == SIM_MODE_CASCADE)
+        {
+            piq.qOut = piq.qIprevOut = piq.qLowOutLim;   // Start from the minimum duty
+            ccr1 = mppt.u16Duty;
+        }
+    }
+
+    if (ptCsv)
+        fprintf(ptCsv, "t,G,T,duty,vpv,ipv,ppv,pmpp,vout\n");
+
+    for (k = 0; k < n; k++)
+    {
+        double duty = ccr1 / period;
+        double p;
+
+        if (ptPV)
+        {
+            double g_now = sim_profile_at(&ptCfg->tIrradiance, t);
+            double temp_now = sim_profile_at(&ptCfg->tTemperature, t);
+
+            if (!shaded && ptCfg->tShade.u8Count && t >= ptCfg->dShadeTime)
+            {
+                pv_set_shade(ptPV, &ptCfg->tShade);
+                shaded = 1;
+                g = -1.0;
+            }
+
+            if (g_now != g || temp_now != temp)
+            {
+                g = g_now;
+                temp = temp_now;
+                pv_set_conditions(ptPV, g, temp);
+                pmpp = pv_mpp(ptPV, 0);
+            }
+        }
+
+        if (ptCfg->tLoad.u8Count)
+            boost.dR = sim_profile_at(&ptCfg->tLoad, t);
+
+        // Main loop delay, the PWM runs at the last duty
+        boost_run(&boost, ptPV, duty, ptCfg->dSamplePeriod, ptCfg->dH);
+        t = (k + 1) * ptCfg->dSamplePeriod;
+
+        p = boost.dVin * boost.dIin;
+        ptResult->dEnergy += p * ptCfg->dSamplePeriod;
+        ptResult->dEnergyMpp += pmpp * ptCfg->dSamplePeriod;
+        ptResult->u32Samples++;
+
+        // With the auto-tune, from the end of the relay experiment on
+        if (ptResult->dSettleTime < 0.0 && (!ptCfg->u8Tune || ptResult->dTuneTime > 0.0))
+        {
+            if (ptCfg->u8Mode != SIM_MODE_PI ? p >= 0.95 * pmpp
+                : boost.dVout >= 0.95 * ptCfg->fVref && boost.dVout <= 1.05 * ptCfg->fVref)
+                ptResult->dSettleTime = t;
+        }
+
+        // Dropouts once the tracker has held the MPP for a second, the
+        // start up transient does not count
+        if (ptCfg->u8Mode != SIM_MODE_PI)
+        {
+            if (p >= 0.95 * pmpp)
+            {
+                if (above < 0.0)
+                    above = t;
+                if (t - above >= 1.0)
+                    tracking = 1;
+                below = -1.0;
+            }
+            else
+            {
+                above = -1.0;
+                if (tracking && below < 0.0)
+                    below = t;
+                if (tracking && t - below > ptResult->dRecoverTime)
+                    ptResult->dRecoverTime = t - below;
+            }
+        }
+
+        if (ptCfg->u8Mode == SIM_MODE_PI && ptResult->dSettleTime >= 0.0 &&
+            fabs(boost.dVout - ptCfg->fVref) > ptResult->dVoutDev)
+            ptResult->dVoutDev = fabs(boost.dVout - ptCfg->fVref);
+
+        if (ptCfg->u8Mode == SIM_MODE_PI && t > ptCfg->dStepTime)
+        {
+            if (boost.dVout - ptCfg->fVref > ptResult->dOvershoot)
+                ptResult->dOvershoot = boost.dVout - ptCfg->fVref;
+            if (ptCfg->fVref - boost.dVout > ptResult->dUndershoot)
+                ptResult->dUndershoot = ptCfg->fVref - boost.dVout;
+            if (fabs(boost.dVout - ptCfg->fVref) > 0.05 * ptCfg->fVref)
+                out5 = t;
+        }
+
+        if (t >= 0.8 * ptCfg->dDuration)
+        {
+            if (duty < duty_min) duty_min = duty;
+            if (duty > duty_max) duty_max = duty;
+        }
+
+        if (ptCsv)
+            fprintf(ptCsv, "%.3f,%.1f,%.1f,%.4f,%.3f,%.4f,%.2f,%.2f,%.3f\n",
+                    t, g, temp, duty, boost.dVin, boost.dIin, p, pmpp, boost.dVout);
+
+        // Conversion + ADC12 ISR + rest of the main loop
+        if (ptCfg->u8Mode == SIM_MODE_MPPT)
+        {
+            if (ptCfg->u16AdcBlock)
+            {
+                // DMA blocks of single conversions, the decimation in
+                // mppt_sample_block sees the real quantisation and dither
+                uint16_t n = ptCfg->u16AdcBlock < SIM_ADC_BLOCK_MAX ? ptCfg->u16AdcBlock : SIM_ADC_BLOCK_MAX;
+                uint16_t b, k;
+
+                for (b = 0; b < ptCfg->u16AdcBlocks; b++)
+                {
+                    for (k = 0; k < n; k++)
+                    {
+                        block_v[k] = sim_adc_voltage(boost.dVin, ptCfg->dNoiseLsb, &u32Rng);
+                        block_i[k] = sim_adc_current(boost.dIin, ptCfg->dNoiseLsb, &u32Rng);
+                    }
+                    mppt_sample_block(&mppt, block_v, block_i, n);
+                }
+            }
+            else
+            {
+                // A10/A7 sequence, both from the same plant state
+                block_v[0] = sim_adc_voltage(boost.dVin, ptCfg->dNoiseLsb, &u32Rng);
+                block_i[0] = sim_adc_current(boost.dIin, ptCfg->dNoiseLsb, &u32Rng);
+                mppt_sample_block(&mppt, block_v, block_i, 1);
+            }
+
+            if (mppt_ready(&mppt))
+            {
+                mppt_algorithm(&mppt);
+                ccr1 = mppt.u16Duty;
+            }
+        }
+        else if (ptCfg->u8Mode == SIM_MODE_CASCADE)
+        {
+            // Control ISR: PV voltage PI on every pair, the pairs are summed
+            // into block averages for the MPPT in the main loop
+            uint16_t v_adc = sim_adc_voltage(boost.dVin, ptCfg->dNoiseLsb, &u32Rng);
+            uint16_t i_adc = sim_adc_current(boost.dIin, ptCfg->dNoiseLsb, &u32Rng);
+            uint16_t avg_adc = tFILTER_push(&filter, v_adc);
+
+            if (filter.u8Full)
+            {
+                piq.qIn = PI_MV_TO_Q16(sensor_voltage_mv(avg_adc) - mppt_vref_mv(&mppt));
+                tPIQ_calc(&piq);
+                ccr1 = tPIQ_counts(piq.qOut, ptCfg->u16PwmCcr0);
+            }
+
+            sum_v += v_adc;
+            sum_i += i_adc;
+            if (++pairs >= ptCfg->u16AdcBlock)
+            {
+                mppt_sample(&mppt, MPPT_CH_VOLTAGE, (uint16_t)(((sum_v << mppt.u8OsBits) + pairs / 2) / pairs));
+                mppt_sample(&mppt, MPPT_CH_CURRENT, (uint16_t)(((sum_i << mppt.u8OsBits) + pairs / 2) / pairs));
+                sum_v = sum_i = 0;
+                pairs = 0;
+
+                if (++blocks >= ptCfg->u16AdcBlocks)
+                {
+                    blocks = 0;
+                    if (mppt_ready(&mppt))
+                    {
+                        if (ccr1 <= mppt.u16MinDuty || ccr1 >= mppt.u16MaxDuty)
+                            mppt_vref_sync(&mppt);
+                        mppt_algorithm(&mppt);
+                    }
+                }
+            }
+        }
+        else
+        {
+            uint16_t vout_adc = sim_adc_voltage(boost.dVout, ptCfg->dNoiseLsb, &u32Rng);
+            uint16_t avg_adc = tFILTER_push(&filter, vout_adc);
+            int32_t vin_mv = 0;
+
+            // Input voltage through a second sensor like the output one
+            if (ptCfg->u8Feedforward)
+                vin_mv = sensor_voltage_mv(sim_adc_voltage(boost.dVin, ptCfg->dNoiseLsb, &u32Rng));
+
+            if (ptCfg->u8Mpc)
+            {
+                // Every A10/A7 pair, the current sensor in series with the inductor
+                mpc.i32VoutMv = sensor_voltage_mv(vout_adc);
+                mpc.i32IlMa = sensor_current_ma(sim_adc_current(boost.dIind, ptCfg->dNoiseLsb, &u32Rng));
+                if (ptCfg->u8Feedforward)
+                    mpc.i32VinMv = vin_mv;
+                tMPC_calc(&mpc);
+                ccr1 = mpc.u16Count;
+            }
+            else if (filter.u8Full && ptCfg->u8Tune && ptResult->dTuneTime == 0.0 && tune.u8State == TUNE_IDLE)
+            {
+                // Relay around the boost duty of the measured input
+                tune.qBias = tPIQ_boost_ff(sensor_voltage_mv(sim_adc_voltage(boost.dVin, ptCfg->dNoiseLsb, &u32Rng)),
+                                           (int32_t)(ptCfg->fVref * 1000.0f));
+                tune_start(&tune);
+            }
+
+            if (filter.u8Full && tune.u8State != TUNE_IDLE)
+            {
+                int32_t qDuty = tune_step(&tune, (int32_t)(ptCfg->fVref * 1000.0f) - sensor_voltage_mv(avg_adc));
+
+                ccr1 = tPIQ_counts(qDuty, ptCfg->u16PwmCcr0);
+
+                // Main loop: new gains, then the PI takes over from the bias
+                if (tune.u8State != TUNE_RUNNING)
+                {
+                    ptResult->dTuneTime = t;
+                    if (tune_result(&tune, (float)ptCfg->dSamplePeriod, &ptResult->fKu, &ptResult->fTu) &&
+                        tune_gains(ptResult->fKu, ptResult->fTu, &ptResult->fKp, &ptResult->fKi))
+                    {
+                        pi.fKp = ptResult->fKp;
+                        pi.fKi = ptResult->fKi;
+                        piq.qKp = PI_Q24(pi.fKp);
+                        piq.qKi = PI_Q24(pi.fKi);
+                        ptResult->u8Tuned = 1;
+                    }
+                    tPI_rst(&pi);
+                    tPIQ_rst(&piq);
+                    pi.fIout = pi.fIprevOut = tune.qBias / 16777216.0f;
+                    piq.qIout = piq.qIprevOut = tune.qBias;
+                    if (ptCfg->u8Feedforward)
+                    {
+                        pi.fIout = pi.fIprevOut = 0.0f;
+                        piq.qIout = piq.qIprevOut = 0;
+                    }
+                    tune.u8State = TUNE_IDLE;
+                }
+            }
+            else if (filter.u8Full && !ptCfg->u8Mpc)
+            {
+                if (ptCfg->u8Fixed)
+                {
+                    int32_t voltage_mv = sensor_voltage_mv(avg_adc);
+                    int32_t qDuty;
+
+                    if (ptCfg->u8Feedforward)
+                        piq.qFf = tPIQ_boost_ff(vin_mv, (int32_t)(ptCfg->fVref * 1000.0f));
+                    piq.qIn = PI_MV_TO_Q16((int32_t)(ptCfg->fVref * 1000.0f) - voltage_mv);
+                    tPIQ_calc(&piq);
+                    qDuty = piq.qOut;
+                    if (qDuty > PI_Q24(ptCfg->fDutyMax))
+                        qDuty = PI_Q24(ptCfg->fDutyMax);
+
+                    ccr1 = tPIQ_counts(qDuty, ptCfg->u16PwmCcr0);
+                }
+                else
+                {
+                    float voltage = 772.0f * ((avg_adc * 2.5f) / 4096.0f - 1.286f);
+                    float duty_cycle;
+
+                    if (ptCfg->u8Feedforward)
+                        pi.fFf = tPI_boost_ff(vin_mv / 1000.0f, ptCfg->fVref);
+                    pi.fIn = ptCfg->fVref - voltage;
+                    tPI_calc(&pi);
+                    duty_cycle = pi.fOut;
+                    if (duty_cycle > ptCfg->fDutyMax)
+                        duty_cycle = ptCfg->fDutyMax;
+
+                    ccr1 = tPI_counts(duty_cycle, ptCfg->u16PwmCcr0);
+                }
+            }
+        }
+    }
+
+    if (ptResult->dEnergyMpp > 0.0)
+        ptResult->dEfficiency = ptResult->dEnergy / ptResult->dEnergyMpp;
+    ptResult->dDutyRipple = duty_max >= duty_min ? duty_max - duty_min : 0.0;
+    ptResult->dSettle5 = out5 > ptCfg->dStepTime ? out5 - ptCfg->dStepTime : 0.0;
+    ptResult->dPower = boost.dVin * boost.dIin;
+    ptResult->dVout = boost.dVout;
+}
@@ -0,0 +1,93 @@
+#ifndef SIM_LOOP_H
+#define SIM_LOOP_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "PV_SIM.h"
+#include "MPPT_CTRL.h"
+#include "PI.h"
+#include "AUTOTUNE.h"
+#include "MPC.h"
+
+// Closed loop runs of the control code (mppt_algorithm, tPI_calc/tPIQ_calc, tMPC_calc)
+// against the PV_SIM plant, with the same sample timing as the firmware.
+
+#define SIM_MODE_MPPT   0       // MPPT.c: P&O on the PV side
+#define SIM_MODE_PI     1       // CLOSE_LOOP_BOOST_PI.c: output voltage PI
+#define SIM_MODE_CASCADE 2      // MPPT_PI.c: MPPT reference for a PV voltage PI
+
+#define SIM_PROFILE_MAX 8
+#define SIM_ADC_BLOCK_MAX 256   // Longest simulated DMA block (pairs)
+
+// Piecewise linear input profile, held constant outside the given points
+typedef struct {
+    uint8_t u8Count;
+    double adTime[SIM_PROFILE_MAX];
+    double adValue[SIM_PROFILE_MAX];
+} tSIM_PROFILE;
+
+typedef struct {
+    uint8_t u8Mode;             // SIM_MODE_MPPT, SIM_MODE_PI or SIM_MODE_CASCADE
+    uint8_t u8Fixed;            // SIM_MODE_PI: 1 runs tPIQ_calc, 0 runs tPI_calc. SIM_MODE_CASCADE: always tPIQ
+    double dDuration;           // Simulated time (s)
+    double dSamplePeriod;       // Time between firmware steps (s): the MPPT loop, or the control ISR of the PI modes
+    double dH;                  // Plant integration step (s)
+    double dNoiseLsb;           // ADC noise, standard deviation in LSB
+    uint32_t u32Seed;           // Noise seed
+
+    uint16_t u16Nser;           // PV array, 0 uses the tBoost DC source instead
+    uint16_t u16Npar;
+    tSIM_PROFILE tIrradiance;   // W/m^2 over time
+    tSIM_PROFILE tTemperature;  // deg C over time
+    tPV_SHADE tShade;           // Partial shading, applied from dShadeTime on
+    double dShadeTime;
+
+    tBOOST tBoost;              // Converter parameters, states are ignored
+    tSIM_PROFILE tLoad;         // Load resistance over time (ohm), empty keeps tBoost.dR
+    uint16_t u16PwmCcr0;        // TA1CCR0, duty = TA1CCR1 / (TA1CCR0 + 1)
+
+    tMPPT tMpptSet;             // SIM_MODE_MPPT, SIM_MODE_CASCADE: controller settings
+    uint16_t u16AdcBlock;       // SIM_MODE_MPPT: pairs per DMA block, 0 = one pair per sample period
+                                // SIM_MODE_CASCADE: control samples averaged into one MPPT sample
+    uint16_t u16AdcBlocks;      // SIM_MODE_MPPT: blocks per sample period. SIM_MODE_CASCADE: per MPPT step
+    tPI tPiSet;                 // SIM_MODE_PI, SIM_MODE_CASCADE: gains and limits
+    uint16_t u16PiFilterSize;   // SIM_MODE_PI, SIM_MODE_CASCADE: ADC filter window
+    float fVref;                // SIM_MODE_PI: output voltage reference (V)
+    float fDutyMax;             // SIM_MODE_PI: duty clamp after the PI
+    uint8_t u8Feedforward;      // SIM_MODE_PI: 1 adds the boost duty of the measured input voltage
+    uint8_t u8Tune;             // SIM_MODE_PI: 1 replaces tPiSet gains by a relay auto-tune at start
+    tTUNE tTuneSet;             // SIM_MODE_PI: relay settings
+    uint8_t u8Mpc;              // SIM_MODE_PI: 1 runs tMPC_calc on every unfiltered sample instead of the PI
+    tMPC tMpcSet;               // SIM_MODE_PI: MPC weights and observer, the model comes from tBoost
+    double dStepTime;           // SIM_MODE_PI: dOvershoot, dUndershoot and dSettle5 count from here (s)
+} tSIM_CFG;
+
+typedef struct {
+    double dEnergy;             // Energy taken from the PV array (J)
+    double dEnergyMpp;          // Energy available at the MPP (J)
+    double dEfficiency;         // dEnergy / dEnergyMpp
+    double dSettleTime;         // First time within 5% of the target (s), -1 if never
+    double dRecoverTime;        // Longest time below 95% of the MPP power after holding it for 1s (s)
+    double dVoutDev;            // SIM_MODE_PI: largest |Vout - Vref| once settled (V)
+    double dDutyRipple;         // Duty peak to peak over the last 20% of the run
+    double dPower;              // Final PV power (W)
+    double dVout;               // Final output voltage (V)
+    uint32_t u32Samples;        // ADC conversions simulated
+    uint8_t u8Tuned;            // Relay auto-tune finished, the gains below were used
+    double dTuneTime;           // Length of the relay experiment (s)
+    float fKu;                  // Ultimate gain (duty / V)
+    float fTu;                  // Ultimate period (s)
+    float fKp;                  // Gains from tune_gains()
+    float fKi;
+    double dOvershoot;          // SIM_MODE_PI: largest Vout - Vref from dStepTime on (V)
+    double dUndershoot;         // SIM_MODE_PI: largest Vref - Vout from dStepTime on (V)
+    double dSettle5;            // SIM_MODE_PI: time from dStepTime until Vout stays within 5% (s)
+} tSIM_RESULT;
+
+void sim_default_mppt(tSIM_CFG* ptCfg);
+void sim_default_pi(tSIM_CFG* ptCfg);
+void sim_default_cascade(tSIM_CFG* ptCfg);
+double sim_profile_at(const tSIM_PROFILE* ptProfile, double dTime);
+void sim_run(const tSIM_CFG* ptCfg, tSIM_RESULT* ptResult, FILE* ptCsv);
+
+#endif
@@ -0,0 +1,83 @@
+// Time from reset to 95% of the MPP power for the MPPT.c tracker starting
+// at the minimum duty and with the fractional Voc fast start, closed loop
+// against PV_SIM at fixed irradiance and temperature (a cold array after
+// an eclipse, a hot one in full sun). The fast start has to get there
+// within STARTUP_LIMIT everywhere, never later than the minimum duty start,
+// and collect as much energy over the run as it does: where the MPP is
+// already near the minimum duty a jump away from it costs more than it saves.
+//
+// Build: gcc -O2 -o startup_bench STARTUP_BENCH.c SIM_LOOP.c PV_SIM.c MPPT_CTRL.c PI.c ADC_FILTER.c SENSOR.c AUTOTUNE.c MPC.c -lm
+// Returns nonzero if any case fails.
+
+#include <stdio.h>
+#include "SIM_LOOP.h"
+
+typedef struct {
+    double dG;                  // W/m^2
+    double dT;                  // deg C
+} tCASE;
+
+// The MPP of the simulated array stays inside the duty window for these
+static const tCASE cases[] = {
+    {  700.0, -20.0 }, {  700.0, 25.0 }, {  700.0, 80.0 },
+    {  850.0, -20.0 }, {  850.0, 25.0 }, {  850.0, 80.0 },
+    { 1000.0, -20.0 }, { 1000.0, 25.0 }, { 1000.0, 80.0 },
+};
+#define NCASES (sizeof(cases) / sizeof(cases[0]))
+
+#define STARTUP_LIMIT 2.5       // s, a few settling intervals of 128 ms steps
+#define ENERGY_SLACK 0.0005     // The probe interval, a step off the MPP for under 0.5 s of 30 s
+
+static void run(const tCASE* ptCase, uint16_t u16FocvK, tSIM_RESULT* ptResult)
+{
+    tSIM_CFG cfg;
+
+    sim_default_mppt(&cfg);
+    cfg.dDuration = 30.0;
+    cfg.tMpptSet.u16FocvK = u16FocvK;
+    cfg.tIrradiance.adValue[0] = ptCase->dG;
+    cfg.tTemperature.adValue[0] = ptCase->dT;
+    sim_run(&cfg, ptResult, 0);
+}
+
+int main(void)
+{
+    tSIM_RESULT slow, fast;
+    int fails = 0;
+    unsigned c;
+
+    printf("%-18s %21s %21s\n", "", "minimum duty", "fast start");
+    printf("%-18s %10s %10s %10s %10s\n", "case", "to 95%", "energy", "to 95%", "energy");
+
+    for (c = 0; c < NCASES; c++)
+    {
+        char name[32];
+
+        run(&cases[c], 0, &slow);
+        run(&cases[c], 850, &fast);
+
+        snprintf(name, sizeof(name), "%.0f W/m^2 %.0f C", cases[c].dG, cases[c].dT);
+        printf("%-18s %9.3fs %9.2f%% %9.3fs %9.2f%%\n", name,
+               slow.dSettleTime, slow.dEfficiency * 100.0,
+               fast.dSettleTime, fast.dEfficiency * 100.0);
+
+        if (fast.dSettleTime < 0.0 || fast.dSettleTime > STARTUP_LIMIT)
+        {
+            printf("  FAIL: fast start not at 95%% within %.1f s\n", STARTUP_LIMIT);
+            fails++;
+        }
+        else if (slow.dSettleTime >= 0.0 && fast.dSettleTime > slow.dSettleTime)
+        {
+            printf("  FAIL: fast start slower than the minimum duty start\n");
+            fails++;
+        }
+        else if (fast.dEfficiency < slow.dEfficiency - ENERGY_SLACK)
+        {
+            printf("  FAIL: fast start collected less energy than the minimum duty start\n");
+            fails++;
+        }
+    }
+
+    printf("%d of %u cases failed\n", fails, (unsigned)NCASES);
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,384 @@
+// Parallel scenario sweep over SIM_LOOP, one CSV row per scenario.
+// Scenarios are spread over worker threads with a work-stealing pool.
+//
+// Build: gcc -O2 -pthread -o sweep SWEEP.c SIM_LOOP.c PV_SIM.c MPPT_CTRL.c PI.c ADC_FILTER.c SENSOR.c AUTOTUNE.c MPC.c -lm
+// Usage: ./sweep [mode=mppt|pi] [key=v1,v2,...] [threads=N] [out=file.csv]
+//
+//   mode=mppt: dstep=5,10,20 delay=5,10,15 filter=2,4,8 seeds=2 time=300
+//              alg=po,inc,dppo (default po) vscale=0,850 (variable step gain, default 0)
+//              pso=0,5 (global search particles, default 0)
+//              profiles=const,step,ramp,clouds,heat (default all)
+//   mode=pi:   kp=0.005,0.01,0.02 ki=3,10.5,25.5 vdc=40,50,60 seeds=2 time=20
+//              (load steps from 73 to 36 ohm at half time)
+//
+// Rows are written in scenario order whatever the thread count, so two runs
+// with the same arguments give the same file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "SIM_LOOP.h"
+
+#define SWEEP_LIST_MAX   16
+#define SWEEP_THREAD_MAX 256
+
+typedef struct {
+    const char *pcName;
+    tSIM_PROFILE tIrradiance;
+    tSIM_PROFILE tTemperature;
+    tPV_SHADE tShade;
+    double dShadeTime;
+} tSWEEP_PROFILE;
+
+// Irradiance (W/m^2) and temperature (deg C) test profiles
+static const tSWEEP_PROFILE sweep_profiles[] = {
+    { "const",  { 1, { 0 }, { 1000 } },                                    { 1, { 0 }, { 25 } },
+                { 0 }, 0 },
+    { "step",   { 3, { 0, 100, 101 }, { 1000, 1000, 500 } },               { 1, { 0 }, { 25 } },
+                { 0 }, 0 },
+    { "ramp",   { 3, { 0, 30, 150 }, { 300, 300, 1000 } },                 { 1, { 0 }, { 25 } },
+                { 0 }, 0 },
+    { "clouds", { 8, { 0, 60, 62, 90, 92, 150, 155, 200 },
+                     { 1000, 1000, 400, 400, 900, 900, 300, 800 } },      { 1, { 0 }, { 25 } },
+                { 0 }, 0 },
+    { "heat",   { 1, { 0 }, { 1000 } },                                    { 2, { 0, 300 }, { 25, 65 } },
+                { 0 }, 0 },
+    { "shade",  { 1, { 0 }, { 1000 } },                                    { 1, { 0 }, { 25 } },
+                { 1, { 2 }, { 0.5 } }, 100 },
+};
+#define SWEEP_NPROFILES (sizeof(sweep_profiles) / sizeof(sweep_profiles[0]))
+
+typedef struct {
+    uint8_t u8Profile;
+    uint32_t u32Seed;
+    tSIM_CFG tCfg;
+    tSIM_RESULT tResult;
+} tSWEEP_JOB;
+
+// Per worker deque of job indices [u32Head, u32Tail). The owner pops from
+// the tail, thieves take from the head.
+typedef struct {
+    pthread_mutex_t tLock;
+    uint32_t u32Head;
+    uint32_t u32Tail;
+} tSWEEP_DEQUE;
+
+static tSWEEP_JOB *jobs;
+static uint32_t njobs;
+static tSWEEP_DEQUE deques[SWEEP_THREAD_MAX];
+static unsigned nthreads;
+static volatile uint32_t done;
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int pop_own(unsigned id, uint32_t *pu32Job)
+{
+    tSWEEP_DEQUE *d = &deques[id];
+    int ok = 0;
+
+    pthread_mutex_lock(&d->tLock);
+    if (d->u32Tail > d->u32Head)
+    {
+        *pu32Job = --d->u32Tail;
+        ok = 1;
+    }
+    pthread_mutex_unlock(&d->tLock);
+    return ok;
+}
+
+static int steal(unsigned id, uint32_t *pu32Job)
+{
+    unsigned k;
+
+    for (k = 1; k < nthreads; k++)
+    {
+        tSWEEP_DEQUE *d = &deques[(id + k) % nthreads];
+        int ok = 0;
+
+        pthread_mutex_lock(&d->tLock);
+        if (d->u32Tail > d->u32Head)
+        {
+            *pu32Job = d->u32Head++;
+            ok = 1;
+        }
+        pthread_mutex_unlock(&d->tLock);
+
+        if (ok)
+            return 1;
+    }
+    return 0;
+}
+
+static void *worker(void *arg)
+{
+    unsigned id = (unsigned)(size_t)arg;
+    uint32_t j;
+
+    while (pop_own(id, &j) || steal(id, &j))
+    {
+        sim_run(&jobs[j].tCfg, &jobs[j].tResult, 0);
+
+        pthread_mutex_lock(&done_lock);
+        done++;
+        if (done % 100 == 0 || done == njobs)
+            fprintf(stderr, "\r%u/%u scenarios", (unsigned)done, (unsigned)njobs);
+        pthread_mutex_unlock(&done_lock);
+    }
+    return 0;
+}
+
+static int parse_list(const char *str, double *pdList)
+{
+    int n = 0;
+
+    while (*str && n < SWEEP_LIST_MAX)
+    {
+        char *end;
+        pdList[n] = strtod(str, &end);
+        if (end == str)
+            return -1;
+        n++;
+        str = *end == ',' ? end + 1 : end;
+    }
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    double dstep[SWEEP_LIST_MAX] = { 5, 10, 20 };
+    double delay[SWEEP_LIST_MAX] = { 5, 10, 15 };
+    double filter[SWEEP_LIST_MAX] = { 2, 4, 8 };
+    double kp[SWEEP_LIST_MAX] = { 0.005, 0.01, 0.02 };
+    double ki[SWEEP_LIST_MAX] = { 5, 20, 50 };
+    double vdc[SWEEP_LIST_MAX] = { 40, 50, 60 };
+    double vscale[SWEEP_LIST_MAX] = { 0 };
+    double pso[SWEEP_LIST_MAX] = { 0 };
+    int ndstep = 3, ndelay = 3, nfilter = 3, nkp = 3, nki = 3, nvdc = 3, nvscale = 1, npso = 1;
+    uint8_t use_profile[SWEEP_NPROFILES];
+    uint8_t algs[3] = { MPPT_MODE_PO, MPPT_MODE_INCCOND, MPPT_MODE_DPPO };
+    int nalg = 1;
+    uint8_t mode = SIM_MODE_MPPT;
+    uint32_t seeds = 2;
+    double duration = -1.0;
+    const char *out_name = 0;
+    FILE *out = stdout;
+    pthread_t threads[SWEEP_THREAD_MAX];
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t j, k, per;
+    unsigned t;
+    int i, a, b, c, p, m, v, g;
+    uint32_t s;
+
+    nthreads = ncpu > 0 ? (unsigned)ncpu : 1;
+    memset(use_profile, 1, sizeof(use_profile));
+
+    for (i = 1; i < argc; i++)
+    {
+        char *val = strchr(argv[i], '=');
+        const char *key = argv[i];
+        int n = 0;
+
+        if (!val)
+        {
+            fprintf(stderr, "bad argument '%s'\n", argv[i]);
+            return 2;
+        }
+        *val++ = '\0';
+
+        if (strcmp(key, "mode") == 0) mode = strcmp(val, "pi") == 0 ? SIM_MODE_PI : SIM_MODE_MPPT;
+        else if (strcmp(key, "dstep") == 0) n = ndstep = parse_list(val, dstep);
+        else if (strcmp(key, "delay") == 0) n = ndelay = parse_list(val, delay);
+        else if (strcmp(key, "filter") == 0) n = nfilter = parse_list(val, filter);
+        else if (strcmp(key, "vscale") == 0) n = nvscale = parse_list(val, vscale);
+        else if (strcmp(key, "pso") == 0) n = npso = parse_list(val, pso);
+        else if (strcmp(key, "kp") == 0) n = nkp = parse_list(val, kp);
+        else if (strcmp(key, "ki") == 0) n = nki = parse_list(val, ki);
+        else if (strcmp(key, "vdc") == 0) n = nvdc = parse_list(val, vdc);
+        else if (strcmp(key, "seeds") == 0) seeds = (uint32_t)atoi(val);
+        else if (strcmp(key, "time") == 0) duration = atof(val);
+        else if (strcmp(key, "threads") == 0) nthreads = (unsigned)atoi(val);
+        else if (strcmp(key, "out") == 0) out_name = val;
+        else if (strcmp(key, "alg") == 0)
+        {
+            char *tok;
+
+            nalg = 0;
+            for (tok = strtok(val, ","); tok && nalg < 3; tok = strtok(0, ","))
+            {
+                if (strcmp(tok, "po") == 0) algs[nalg++] = MPPT_MODE_PO;
+                else if (strcmp(tok, "inc") == 0) algs[nalg++] = MPPT_MODE_INCCOND;
+                else if (strcmp(tok, "dppo") == 0) algs[nalg++] = MPPT_MODE_DPPO;
+                else break;
+            }
+            if (!nalg || tok) n = -1;
+        }
+        else if (strcmp(key, "profiles") == 0)
+        {
+            memset(use_profile, 0, sizeof(use_profile));
+            for (p = 0; p < (int)SWEEP_NPROFILES; p++)
+                use_profile[p] = strstr(val, sweep_profiles[p].pcName) != 0;
+        }
+        else n = -1;
+
+        if (n < 0)
+        {
+            fprintf(stderr, "bad argument '%s=%s'\n", key, val);
+            return 2;
+        }
+    }
+
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > SWEEP_THREAD_MAX) nthreads = SWEEP_THREAD_MAX;
+    if (seeds < 1) seeds = 1;
+
+    // Build the scenario list
+    if (mode == SIM_MODE_MPPT)
+        njobs = (uint32_t)(SWEEP_NPROFILES * nalg * nvscale * npso * ndstep * ndelay * nfilter) * seeds;
+    else
+        njobs = (uint32_t)(nkp * nki * nvdc) * seeds;
+
+    jobs = calloc(njobs, sizeof(*jobs));
+    if (!jobs)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    j = 0;
+    if (mode == SIM_MODE_MPPT)
+    {
+        for (k = 0; k < njobs; k++)
+        {
+            tSIM_CFG *cfg = &jobs[j].tCfg;
+            uint32_t r = k;
+
+            // Seed varies fastest, profile slowest
+            s = r % seeds + 1;      r /= seeds;
+            c = (int)(r % nfilter); r /= nfilter;
+            b = (int)(r % ndelay);  r /= ndelay;
+            a = (int)(r % ndstep);  r /= ndstep;
+            v = (int)(r % nvscale); r /= nvscale;
+            g = (int)(r % npso);    r /= npso;
+            m = (int)(r % nalg);    r /= nalg;
+            p = (int)r;
+
+            if (!use_profile[p])
+                continue;
+
+            sim_default_mppt(cfg);
+            if (duration > 0.0) cfg->dDuration = duration;
+            cfg->u32Seed = s;
+            cfg->tIrradiance = sweep_profiles[p].tIrradiance;
+            cfg->tTemperature = sweep_profiles[p].tTemperature;
+            cfg->tShade = sweep_profiles[p].tShade;
+            cfg->dShadeTime = sweep_profiles[p].dShadeTime;
+            cfg->tMpptSet.u8Particles = (uint8_t)pso[g];
+            cfg->tMpptSet.u8Mode = algs[m];
+            cfg->tMpptSet.u16StepScale = (uint16_t)vscale[v];
+            cfg->tMpptSet.u16DutyStep = (uint16_t)dstep[a];
+            cfg->tMpptSet.u8Delay = (uint8_t)delay[b];
+            cfg->tMpptSet.u16FilterSize = (uint16_t)filter[c];
+            if (cfg->tMpptSet.u16FilterSize > MPPT_FILTER_MAX)
+                cfg->tMpptSet.u16FilterSize = MPPT_FILTER_MAX;
+
+            jobs[j].u8Profile = (uint8_t)p;
+            jobs[j].u32Seed = s;
+            j++;
+        }
+    }
+    else
+    {
+        for (a = 0; a < nkp; a++)
+            for (b = 0; b < nki; b++)
+                for (c = 0; c < nvdc; c++)
+                    for (s = 1; s <= seeds; s++)
+                    {
+                        tSIM_CFG *cfg = &jobs[j].tCfg;
+
+                        sim_default_pi(cfg);
+                        if (duration > 0.0) cfg->dDuration = duration;
+                        cfg->u32Seed = s;
+                        cfg->tPiSet.fKp = (float)kp[a];
+                        cfg->tPiSet.fKi = (float)ki[b];
+                        cfg->tBoost.dVdc = vdc[c];
+
+                        // Load step half way, scored by dVoutDev
+                        cfg->tLoad.u8Count = 3;
+                        cfg->tLoad.adTime[0] = 0.0;
+                        cfg->tLoad.adValue[0] = cfg->tBoost.dR;
+                        cfg->tLoad.adTime[1] = 0.5 * cfg->dDuration;
+                        cfg->tLoad.adValue[1] = cfg->tBoost.dR;
+                        cfg->tLoad.adTime[2] = 0.5 * cfg->dDuration + 1e-6;
+                        cfg->tLoad.adValue[2] = 36.0;
+
+                        jobs[j].u32Seed = s;
+                        j++;
+                    }
+    }
+    njobs = j;
+
+    // Deal the scenarios out in contiguous blocks, stealing evens out the
+    // blocks that turn out slower (irradiance changes defeat the plant's
+    // steady state skip, so run times differ a lot between profiles)
+    per = (njobs + nthreads - 1) / nthreads;
+    for (t = 0; t < nthreads; t++)
+    {
+        pthread_mutex_init(&deques[t].tLock, 0);
+        deques[t].u32Head = t * per < njobs ? t * per : njobs;
+        deques[t].u32Tail = (t + 1) * per < njobs ? (t + 1) * per : njobs;
+    }
+
+    for (t = 0; t < nthreads; t++)
+    {
+        if (pthread_create(&threads[t], 0, worker, (void *)(size_t)t) != 0)
+        {
+            fprintf(stderr, "pthread_create failed\n");
+            return 1;
+        }
+    }
+    for (t = 0; t < nthreads; t++)
+        pthread_join(threads[t], 0);
+    fprintf(stderr, "\n");
+
+    if (out_name)
+    {
+        out = fopen(out_name, "w");
+        if (!out)
+        {
+            perror(out_name);
+            return 1;
+        }
+    }
+
+    if (mode == SIM_MODE_MPPT)
+        fprintf(out, "id,profile,alg,vscale,pso,seed,dstep,delay,filter,efficiency,settle_s,duty_ripple,energy_j,energy_mpp_j,final_p_w\n");
+    else
+        fprintf(out, "id,seed,kp,ki,vdc,settle_s,duty_ripple,vout_dev,final_vout\n");
+
+    for (j = 0; j < njobs; j++)
+    {
+        const tSIM_CFG *cfg = &jobs[j].tCfg;
+        const tSIM_RESULT *res = &jobs[j].tResult;
+
+        if (mode == SIM_MODE_MPPT)
+            fprintf(out, "%u,%s,%s,%u,%u,%u,%u,%u,%u,%.5f,%.1f,%.4f,%.1f,%.1f,%.1f\n",
+                    (unsigned)j, sweep_profiles[jobs[j].u8Profile].pcName,
+                    cfg->tMpptSet.u8Mode == MPPT_MODE_INCCOND ? "inc" :
+                    cfg->tMpptSet.u8Mode == MPPT_MODE_DPPO ? "dppo" : "po",
+                    cfg->tMpptSet.u16StepScale, cfg->tMpptSet.u8Particles, (unsigned)jobs[j].u32Seed,
+                    cfg->tMpptSet.u16DutyStep, cfg->tMpptSet.u8Delay, cfg->tMpptSet.u16FilterSize,
+                    res->dEfficiency, res->dSettleTime, res->dDutyRipple,
+                    res->dEnergy, res->dEnergyMpp, res->dPower);
+        else
+            fprintf(out, "%u,%u,%g,%g,%g,%.3f,%.4f,%.2f,%.3f\n",
+                    (unsigned)j, (unsigned)jobs[j].u32Seed,
+                    cfg->tPiSet.fKp, cfg->tPiSet.fKi, cfg->tBoost.dVdc,
+                    res->dSettleTime, res->dDutyRipple, res->dVoutDev, res->dVout);
+    }
+
+    if (out != stdout)
+        fclose(out);
+    free(jobs);
+    return 0;
+}
@@ -0,0 +1,240 @@
+#include "TELEMETRY.h"
+#include "SENSOR.h"
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), byte at a time without a
+// table, only shifts and XORs
+uint16_t telem_crc16(const uint8_t *pu8Data, uint16_t u16Len)
+{
+    uint16_t crc = 0xFFFF;
+
+    while (u16Len--)
+    {
+        crc = (uint16_t)((crc >> 8) | (crc << 8));
+        crc ^= *pu8Data++;
+        crc ^= (crc & 0xFF) >> 4;
+        crc ^= (uint16_t)(crc << 12);
+        crc ^= (uint16_t)((crc & 0xFF) << 5);
+    }
+
+    return crc;
+}
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | ((uint16_t)p[1] << 8));
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    put_u16(p, (uint16_t)v);
+    put_u16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+static int32_t clamp(int32_t v, int32_t lo, int32_t hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+void telem_init(tTELEM* ptTelem, uint8_t u8Type, uint16_t u16PeriodMs)
+{
+    ptTelem->u8Type = u8Type;
+    ptTelem->u16PeriodMs = u16PeriodMs;
+    ptTelem->u8Seq = 0;
+    ptTelem->u8Count = 0;
+}
+
+// Adds a sample to the open frame, returns 1 once the frame is full and
+// telem_frame() has to be called
+uint8_t telem_push(tTELEM* ptTelem, uint32_t u32TimeMs, int32_t i32Voltage, int32_t i32Current, uint16_t u16Duty)
+{
+    uint8_t *p = &ptTelem->au8Raw[TELEM_HEADER_SIZE + ptTelem->u8Count * TELEM_SAMPLE_SIZE];
+
+    if (ptTelem->u8Count >= TELEM_BATCH)
+        return 1;
+
+    if (ptTelem->u8Count == 0)
+        put_u32(&ptTelem->au8Raw[3], u32TimeMs);
+
+    i32Voltage = clamp(i32Voltage, -8388608L, 8388607L);
+    i32Current = clamp(i32Current, -32768L, 32767L);
+
+    p[0] = (uint8_t)i32Voltage;
+    p[1] = (uint8_t)(i32Voltage >> 8);
+    p[2] = (uint8_t)(i32Voltage >> 16);
+    put_u16(p + 3, (uint16_t)i32Current);
+    put_u16(p + 5, u16Duty);
+
+    ptTelem->u8Count++;
+    return ptTelem->u8Count >= TELEM_BATCH;
+}
+
+// Closes the open frame: CRC, COBS encoding into pu8Out (TELEM_FRAME_MAX
+// bytes) and the 0x00 delimiter. Returns the frame length, 0 if no samples.
+// The sequence number advances even if the caller drops the frame.
+uint16_t telem_frame(tTELEM* ptTelem, uint8_t *pu8Out)
+{
+    uint8_t *raw = ptTelem->au8Raw;
+    uint16_t len = TELEM_HEADER_SIZE + ptTelem->u8Count * TELEM_SAMPLE_SIZE;
+    uint16_t i, code_pos = 0, out = 1;
+    uint8_t code = 1;
+
+    if (ptTelem->u8Count == 0)
+        return 0;
+
+    raw[0] = ptTelem->u8Type;
+    raw[1] = ptTelem->u8Seq++;
+    raw[2] = ptTelem->u8Count;
+    put_u16(&raw[7], ptTelem->u16PeriodMs);
+    put_u16(&raw[len], telem_crc16(raw, len));
+    len += 2;
+    ptTelem->u8Count = 0;
+
+    // COBS: every 0x00 is replaced by the distance to the next one
+    for (i = 0; i < len; i++)
+    {
+        if (raw[i] == 0)
+        {
+            pu8Out[code_pos] = code;
+            code_pos = out++;
+            code = 1;
+        }
+        else
+        {
+            pu8Out[out++] = raw[i];
+            if (++code == 0xFF)
+            {
+                pu8Out[code_pos] = code;
+                code_pos = out++;
+                code = 1;
+            }
+        }
+    }
+    pu8Out[code_pos] = code;
+    pu8Out[out++] = 0;
+
+    return out;
+}
+
+void telem_dec_init(tTELEM_DEC* ptDec)
+{
+    ptDec->u16Len = 0;
+    ptDec->u8Overrun = 0;
+    ptDec->u8Synced = 0;
+    ptDec->u8Seq = 0;
+    ptDec->u8HaveSeq = 0;
+    ptDec->u32Frames = 0;
+    ptDec->u32Errors = 0;
+    ptDec->u32Lost = 0;
+}
+
+// COBS decoding in place, returns the decoded length or 0 on a bad frame
+static uint16_t cobs_decode(uint8_t *pu8Buf, uint16_t u16Len)
+{
+    uint16_t in = 0, out = 0;
+
+    while (in < u16Len)
+    {
+        uint8_t code = pu8Buf[in++];
+        uint8_t k;
+
+        if (code == 0 || in + code - 1 > u16Len)
+            return 0;
+
+        for (k = 1; k < code; k++)
+            pu8Buf[out++] = pu8Buf[in++];
+
+        if (code != 0xFF && in < u16Len)
+            pu8Buf[out++] = 0;
+    }
+
+    return out;
+}
+
+static uint8_t parse_frame(tTELEM_DEC* ptDec, tTELEM_SAMPLE* ptOut)
+{
+    uint8_t *raw = ptDec->au8Buf;
+    uint16_t len = cobs_decode(raw, ptDec->u16Len);
+    uint32_t time, period;
+    uint8_t count, seq, k;
+
+    if (len < TELEM_HEADER_SIZE + 2)
+        return 0;
+
+    count = raw[2];
+    if (count == 0 || count > TELEM_BATCH ||
+        len != TELEM_HEADER_SIZE + count * TELEM_SAMPLE_SIZE + 2 ||
+        telem_crc16(raw, len - 2) != get_u16(&raw[len - 2]))
+        return 0;
+
+    seq = raw[1];
+    if (ptDec->u8HaveSeq)
+        ptDec->u32Lost += (uint8_t)(seq - ptDec->u8Seq);
+    ptDec->u8Seq = (uint8_t)(seq + 1);
+    ptDec->u8HaveSeq = 1;
+
+    time = get_u32(&raw[3]);
+    period = get_u16(&raw[7]);
+
+    for (k = 0; k < count; k++)
+    {
+        const uint8_t *p = &raw[TELEM_HEADER_SIZE + k * TELEM_SAMPLE_SIZE];
+        uint32_t v = p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+
+        ptOut[k].u8Type = raw[0];
+        ptOut[k].u8Seq = seq;
+        ptOut[k].u32Time = time + k * period;
+        ptOut[k].i32Voltage = (int32_t)(v ^ 0x800000UL) - 0x800000L;   // Sign extend 24 bits
+        ptOut[k].i32Current = (int16_t)get_u16(p + 3);
+        ptOut[k].u16Duty = get_u16(p + 5);
+        ptOut[k].u16IsrUs = 0;
+        if (raw[0] == TELEM_TYPE_BOOST)
+        {
+            ptOut[k].u16IsrUs = (uint16_t)ptOut[k].i32Current;
+            ptOut[k].i32Current = 0;
+        }
+        ptOut[k].i32Power = sensor_power_mw(ptOut[k].i32Voltage, ptOut[k].i32Current);
+    }
+
+    ptDec->u32Frames++;
+    return count;
+}
+
+// Feeds one received byte. Returns the number of samples written to ptOut
+// (TELEM_BATCH entries) when it completes a good frame, else 0.
+uint8_t telem_dec_byte(tTELEM_DEC* ptDec, uint8_t u8Byte, tTELEM_SAMPLE* ptOut)
+{
+    uint8_t count = 0;
+
+    if (u8Byte != 0)
+    {
+        if (ptDec->u16Len < TELEM_FRAME_MAX)
+            ptDec->au8Buf[ptDec->u16Len++] = u8Byte;
+        else
+            ptDec->u8Overrun = 1;
+        return 0;
+    }
+
+    if (ptDec->u16Len > 0 && ptDec->u8Synced)
+    {
+        if (!ptDec->u8Overrun)
+            count = parse_frame(ptDec, ptOut);
+        if (count == 0)
+            ptDec->u32Errors++;
+    }
+
+    ptDec->u8Synced = 1;
+    ptDec->u8Overrun = 0;
+    ptDec->u16Len = 0;
+    return count;
+}
@@ -0,0 +1,69 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+// Binary telemetry frames, shared by the firmware (encoder) and the PC
+// decoder (TELEM_DECODE.c).
+//
+// A frame batches TELEM_BATCH samples taken every u16PeriodMs:
+//   header   type u8, seq u8, count u8, time of the first sample u32 (ms), period u16 (ms)
+//   samples  voltage i24 (mV), current i16 (mA), duty u16 (TA1CCR1 counts)
+//   crc      CRC-16/CCITT-FALSE of header and samples, u16
+// all little endian, COBS encoded and terminated by a 0x00 byte.
+// Power is not sent, the decoder recomputes it with sensor_power_mw() from
+// the same mV and mA the firmware used.
+
+#define TELEM_TYPE_PV       1   // MPPT.c: PV voltage, current and duty
+#define TELEM_TYPE_BOOST    2   // CLOSE_LOOP_BOOST_PI.c: output voltage and duty, the current
+                                // field carries the longest control ISR time (us)
+
+#define TELEM_BATCH         8   // Samples per frame
+#define TELEM_HEADER_SIZE   9
+#define TELEM_SAMPLE_SIZE   7
+#define TELEM_RAW_MAX       (TELEM_HEADER_SIZE + TELEM_BATCH * TELEM_SAMPLE_SIZE + 2)
+#define TELEM_FRAME_MAX     (TELEM_RAW_MAX + TELEM_RAW_MAX / 254 + 2)   // COBS overhead and delimiter
+
+typedef struct {
+    uint8_t u8Type;
+    uint8_t u8Seq;              // Frame sequence number, gaps are lost frames
+    uint32_t u32Time;           // ms
+    int32_t i32Voltage;         // mV
+    int32_t i32Current;         // mA
+    int32_t i32Power;           // mW, decoder only
+    uint16_t u16Duty;
+    uint16_t u16IsrUs;          // TELEM_TYPE_BOOST: longest control ISR (us), decoder only
+} tTELEM_SAMPLE;
+
+// Encoder, one per stream
+typedef struct {
+    uint8_t u8Type;
+    uint16_t u16PeriodMs;       // Time between telem_push() calls
+    uint8_t u8Seq;
+    uint8_t u8Count;            // Samples in the open frame
+    uint8_t au8Raw[TELEM_RAW_MAX];
+} tTELEM;
+
+// Decoder, fed one received byte at a time
+typedef struct {
+    uint8_t au8Buf[TELEM_FRAME_MAX];
+    uint16_t u16Len;
+    uint8_t u8Overrun;          // Frame longer than TELEM_FRAME_MAX, skipped up to the next delimiter
+    uint8_t u8Synced;           // First delimiter seen, the bytes before it are a partial frame
+    uint8_t u8Seq;              // Expected sequence number of the next frame
+    uint8_t u8HaveSeq;
+    uint32_t u32Frames;         // Good frames
+    uint32_t u32Errors;         // Bad COBS, length or CRC
+    uint32_t u32Lost;           // Frames missing from the sequence
+} tTELEM_DEC;
+
+uint16_t telem_crc16(const uint8_t *pu8Data, uint16_t u16Len);
+
+void telem_init(tTELEM* ptTelem, uint8_t u8Type, uint16_t u16PeriodMs);
+uint8_t telem_push(tTELEM* ptTelem, uint32_t u32TimeMs, int32_t i32Voltage, int32_t i32Current, uint16_t u16Duty);
+uint16_t telem_frame(tTELEM* ptTelem, uint8_t *pu8Out);
+
+void telem_dec_init(tTELEM_DEC* ptDec);
+uint8_t telem_dec_byte(tTELEM_DEC* ptDec, uint8_t u8Byte, tTELEM_SAMPLE* ptOut);
+
+#endif
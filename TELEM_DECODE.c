@@ -0,0 +1,78 @@
+// PC decoder for the binary telemetry of MPPT.c and CLOSE_LOOP_BOOST_PI.c
+// (TELEMETRY.h). Reads the raw UART byte stream and writes one record per
+// sample, then the frame statistics on stderr.
+//
+// Build: gcc -O2 -o telem_decode TELEM_DECODE.c TELEMETRY.c SENSOR.c
+// Usage: ./telem_decode [in=-] [format=csv|cols]
+//
+//   in=/dev/ttyACM0   byte stream (- for stdin), set the port up first with
+//                     stty -F /dev/ttyACM0 115200 raw
+//   format=csv        time_s,seq,type,voltage_v,current_a,power_w,duty,isr_us
+//   format=cols       same fields as aligned columns
+
+#include <stdio.h>
+#include <string.h>
+#include "TELEMETRY.h"
+
+int main(int argc, char **argv)
+{
+    const char *in_name = "-";
+    int cols = 0;
+    FILE *in;
+    tTELEM_DEC dec;
+    tTELEM_SAMPLE samples[TELEM_BATCH];
+    unsigned long records = 0;
+    int c, i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "in=", 3) == 0)
+            in_name = argv[i] + 3;
+        else if (strcmp(argv[i], "format=cols") == 0)
+            cols = 1;
+        else if (strcmp(argv[i], "format=csv") == 0)
+            cols = 0;
+        else
+        {
+            fprintf(stderr, "bad argument '%s'\n", argv[i]);
+            return 2;
+        }
+    }
+
+    in = strcmp(in_name, "-") == 0 ? stdin : fopen(in_name, "rb");
+    if (!in)
+    {
+        perror(in_name);
+        return 1;
+    }
+
+    telem_dec_init(&dec);
+
+    if (cols)
+        printf("%12s %4s %4s %12s %10s %12s %6s %6s\n",
+               "time_s", "seq", "type", "voltage_v", "current_a", "power_w", "duty", "isr_us");
+    else
+        printf("time_s,seq,type,voltage_v,current_a,power_w,duty,isr_us\n");
+
+    while ((c = getc(in)) != EOF)
+    {
+        uint8_t n = telem_dec_byte(&dec, (uint8_t)c, samples);
+
+        for (i = 0; i < n; i++)
+        {
+            const tTELEM_SAMPLE *s = &samples[i];
+
+            printf(cols ? "%12.3f %4u %4u %12.3f %10.3f %12.3f %6u %6u\n" : "%.3f,%u,%u,%.3f,%.3f,%.3f,%u,%u\n",
+                   s->u32Time / 1000.0, s->u8Seq, s->u8Type, s->i32Voltage / 1000.0,
+                   s->i32Current / 1000.0, s->i32Power / 1000.0, s->u16Duty, s->u16IsrUs);
+        }
+        records += n;
+    }
+
+    if (in != stdin)
+        fclose(in);
+
+    fprintf(stderr, "%lu records, %lu frames, %lu lost, %lu bad\n", records,
+            (unsigned long)dec.u32Frames, (unsigned long)dec.u32Lost, (unsigned long)dec.u32Errors);
+    return 0;
+}
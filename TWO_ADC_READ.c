@@ -1,5 +1,6 @@
 #include <msp430.h>
 #include <stdint.h>
+#include "ADC_FILTER.h"
 
 #define FILTER_SIZE 200
 
@@ -8,14 +9,15 @@ volatile float Vout = 0;
 volatile float sensor2 = 0;
 volatile float current = 0;        
 
-volatile uint16_t adc_buffer1[FILTER_SIZE] = {0};
-volatile uint16_t adc_buffer2[FILTER_SIZE] = {0};
-volatile uint16_t buffer_index1 = 0;
-volatile uint16_t buffer_index2 = 0;
+// Only the ISR touches the filters, the main loop reads the flags below
+uint16_t adc_buffer1[FILTER_SIZE];
+uint16_t adc_buffer2[FILTER_SIZE];
+tFILTER filter1;                         // A10
+tFILTER filter2;                         // A7
 volatile uint8_t buffer_full1 = 0;
 volatile uint8_t buffer_full2 = 0;
 
-uint8_t current_channel = 0; // 0 for A10, 1 for A7
+volatile uint8_t current_channel = 0; // 0 for A10, 1 for A7
 
 void uart_init(void);
 void uart_send_string(const char *str);
@@ -43,6 +45,8 @@ int main(void)
     PM5CTL0 &= ~LOCKLPM5;
 
     uart_init();
+    tFILTER_init(&filter1, adc_buffer1, FILTER_SIZE);
+    tFILTER_init(&filter2, adc_buffer2, FILTER_SIZE);
 
     
     while(REFCTL0 & REFGENBUSY);
@@ -165,21 +169,11 @@ void __attribute__ ((interrupt(ADC12_VECTOR))) ADC12_ISR (void)
 
             if (current_channel == 0) // A10
             {
-                adc_buffer1[buffer_index1] = value;
-                buffer_index1++;
-                if (buffer_index1 >= FILTER_SIZE) {
-                    buffer_index1 = 0;
-                    buffer_full1 = 1;
-                }
+                uint16_t avg_adc = tFILTER_push(&filter1, value);
 
-                if (buffer_full1)
+                buffer_full1 = filter1.u8Full;
+                if (filter1.u8Full)
                 {
-                    uint32_t sum = 0;
-                    uint16_t i;
-                    for (i = 0; i < FILTER_SIZE; i++)
-                        sum += adc_buffer1[i];
-                    uint16_t avg_adc = sum / FILTER_SIZE;
-
                     Vout = (avg_adc * 2.5f) / 4096.0f;
                     voltage = 772.0f * (Vout - 1.286f);
 
@@ -193,21 +187,11 @@ void __attribute__ ((interrupt(ADC12_VECTOR))) ADC12_ISR (void)
             }
             else if (current_channel == 1) // A7
             {
-                adc_buffer2[buffer_index2] = value;
-                buffer_index2++;
-                if (buffer_index2 >= FILTER_SIZE) {
-                    buffer_index2 = 0;
-                    buffer_full2 = 1;
-                }
+                uint16_t avg_adc = tFILTER_push(&filter2, value);
 
-                if (buffer_full2)
+                buffer_full2 = filter2.u8Full;
+                if (filter2.u8Full)
                 {
-                    uint32_t sum = 0;
-                    uint16_t i;
-                    for (i = 0; i < FILTER_SIZE; i++)
-                        sum += adc_buffer2[i];
-                    uint16_t avg_adc = sum / FILTER_SIZE;
-
                     sensor2 = (avg_adc * 2.5f) / 4096.0f;
                     current = (sensor2 - 1.65f) / 0.05f;  
                 }